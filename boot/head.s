@@ -20,7 +20,7 @@
 
 .text
 # 声明head.s中的以下标号为全局符号, 供后续C程序使用。
-.globl _idt,_gdt,_pg_dir,_tmp_floppy_area
+.globl _idt,_gdt,_pg_dir,_tmp_floppy_area,_floppy_track_buffer
 # 
 # 页表目录(数据结构)起始处。
 _pg_dir:
@@ -261,6 +261,11 @@ pg3:
 _tmp_floppy_area:
     .fill 1024,1,0
 
+# floppy_track_buffer这18Kb内存用作软驱的柱面缓存(2磁头*18扇区*512字节),
+# 软驱以DMA一次读入整个柱面, 它同样位于1Mb以内且不跨越64Kb边界。#
+_floppy_track_buffer:
+    .fill 512*2*18,1,0
+
 # 在页表相关数据结构设置完毕后, 跳转执行main函数。
 # 在栈中压入
 # 3个0作为main函数参数(未使用),
@@ -533,7 +538,7 @@ idt_descr:
 .align 2
 .word 0
 gdt_descr:
-    .word 256*8-1   # so does gdt (not that that's any
+    .word 261*8-1   # 4+1+NR_TASKS(256) entries (not that that's any
     .long _gdt      # magic number, but it works for me :^)
 
     .align 3
@@ -551,9 +556,10 @@ _idt:   .fill 256,8,0   # idt is uninitialized
 # 0xc0, G=D=1, 内存段颗粒度为4Kb, 默认操作数为32位。
 #
 # GDT[3]保留。
-# GDT[4..]供后续设置LDT或TSS描述符。
+# GDT[4]为所有进程共用的TSS描述符, GDT[5..]为各进程的LDT描述符,
+# 共NR_TASKS(见include/linux/sched.h)个。
 _gdt:   .quad 0x0000000000000000    /* NULL descriptor */
         .quad 0x00c09a0000000fff    /* 16Mb */
         .quad 0x00c0920000000fff    /* 16Mb */
         .quad 0x0000000000000000    /* TEMPORARY - don't use */
-        .fill 252,8,0               /* space for LDT's and TSS's etc */
+        .fill 257,8,0               /* space for the TSS and LDT's */
@@ -46,8 +46,8 @@ int block_write(int dev, long * pos, char * buf, int count)
         written += chars;
         count -= chars;
         /* 将buf内存段中的内容写入到缓冲区块中 */
-        while (chars-->0)
-            *(p++) = get_fs_byte(buf++);
+        memcpy_fromfs(p,buf,chars);
+        buf += chars;
         /* 置缓冲区块已修改标志以标识该缓冲区块可同步到磁盘中 */
         bh->b_dirt = 1;
         brelse(bh);
@@ -85,8 +85,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
         read += chars;
         count -= chars;
         /* 将缓冲区块中所需数据拷贝到出参buf中 */
-        while (chars-->0)
-            put_fs_byte(*(p++),buf++);
+        memcpy_tofs(buf,p,chars);
+        buf += chars;
         brelse(bh);
     }
     return read;
@@ -26,6 +26,7 @@
  * 在时应理解释放软盘缓冲区,所以我觉得把他放在本文件中最为合适。*/
 
 #include <stdarg.h>
+#include <errno.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
@@ -39,31 +40,54 @@
 extern int end;
 
 /* 操作系统程序结束处为buffer开始地址,
+ * buffer_init会在此处先放置hash数组, 再将start_buffer
+ * 指向其后的缓冲区块管理节点数组。
  * struct buffer_head 定义在include/linux/fs.h中。*/
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
 
 /* hash指针数组, 每一个hash指针元素指向一个
- * 节点类型为(struct buffer_head *)的双向循环链表。
- * hash_table[0] --> free_list + i <--> free_list + j ...
+ * 节点类型为(struct buffer_head *)的双向链表。
+ * hash_table[0] --> bh_i <--> bh_j ...
  * ...
- * hash_table[NR_HASH - 1] --> free_list + m <--> free_list + k ...
- * 每一个hash_table各元素指向由哪些节点构成的双向循环链表取决于
- * 节点与hash_table之间如何映射(见 _hashfun)。*/
-struct buffer_head * hash_table[NR_HASH];
-
-/* 指向管理buffer双向链表的头节点 */
-static struct buffer_head * free_list;
-
-/* 用于当前任务等待缓冲区块使用,
- * 其等待机制需结合任务管理的sleep_on和wake_up两个函数进行理解。
- * struct task_struct 定义在include/linux/sched.h中,
- * 是用来管理进程的结构体。*/
-static struct task_struct * buffer_wait = NULL;
+ * hash_table[hash_mask] --> bh_m <--> bh_k ...
+ * 每一个hash_table各元素指向由哪些节点构成的双向链表取决于
+ * 节点与hash_table之间如何映射(见 _hashfun)。
+ *
+ * hash_table不再是固定大小的数组, 而是在buffer_init中根据缓冲
+ * 区块数分配于buffer开始处, 其元素个数为不小于缓冲区块数的2的
+ * 幂, 从而使hash队列的平均长度不超过1。*/
+static struct buffer_head ** hash_table;
+static unsigned int hash_mask;
+
+/* LRU双向循环链表头指针数组,
+ * lru_list[BUF_CLEAN]指向干净缓冲区块链表中最久未被使用的节点,
+ * lru_list[BUF_DIRTY]指向脏缓冲区块链表中最久未被使用的节点;
+ * nr_lru记录各链表中的节点数。*/
+static struct buffer_head * lru_list[NR_LIST];
+int nr_lru[NR_LIST] = {0, };
+
+/* 等待空闲缓冲区块的进程的等待队列(见include/linux/wait.h)。
+ * 等待者为独占等待, 每释放一个缓冲区块只唤醒一个等待者。*/
+static struct wait_queue * buffer_wait = NULL;
 
 /* linux0.11将buffer分成1Kb大小的缓冲区块,
  * NR_BUFFERS用于记录缓冲区块数。*/
 int NR_BUFFERS = 0;
 
+/* 回写守护进程(见sys_bdflush)及其睡眠等待队列。
+ * BDFLUSH_INTERVAL为回写周期;脏LRU链表中的缓冲区块数超过
+ * 缓冲区块总数的1/BDFLUSH_DIRTY_RATIO时也会唤醒回写进程。*/
+#define BDFLUSH_INTERVAL (5*HZ)
+#define BDFLUSH_DIRTY_RATIO 4
+static struct task_struct * bdflush_task = NULL;
+static struct wait_queue * bdflush_wait = NULL;
+
+/* 虚拟硬盘缓冲区块管理节点空闲链表(以b_next_free链接)。
+ * 虚拟硬盘的缓冲区块不占用buffer中的缓冲区块, 其管理节点取自单独
+ * 分配的内存页, b_data直接指向虚拟硬盘内存, 一经建立便一直留在hash
+ * 表中(不进入LRU链表), 所以虚拟硬盘的数据在内存中只有一份。*/
+static struct buffer_head * rd_free_list = NULL;
+
 /* [7] wait_on_buffer,
  * 等待缓冲区管理节点bh被解锁。*/
 static inline void wait_on_buffer(struct buffer_head * bh)
@@ -217,9 +241,10 @@ void check_disk_change(int dev)
         if (super_block[i].s_dev == dev)
             put_super(super_block[i].s_dev);
         
-    /* 释放软盘设备dev i节点和数据所占缓冲区块 */
+    /* 释放软盘设备dev i节点和数据所占缓冲区块及页缓存 */
     invalidate_inodes(dev);
     invalidate_buffers(dev);
+    invalidate_cache_pages(dev,0);
 }
 
 /* 管理缓冲区块节点与hash_table之间的映射关系。
@@ -244,16 +269,15 @@ void check_disk_change(int dev)
  *
  * 为加快搜索速度, hash_table相当于缓冲区管理的缓存管理, 
  * hash队列数NR_HASH可根据系统复杂度调整。*/
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+#define _hashfn(dev,block) (((unsigned)(dev^block))&hash_mask)
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
-/* [12] remove_from_queues,
- * 将缓冲区管理节点bh从其hash队列和其双向循环链表中移除。
+/* [12] remove_from_hash,
+ * 将缓冲区管理节点bh从其hash队列中移除。
  *
  * 该函数可以插入到顺序[6]阅读。*/
-static inline void remove_from_queues(struct buffer_head * bh)
+static inline void remove_from_hash(struct buffer_head * bh)
 {
-/* remove from hash-queue */
     /* 让bh hash队列中的下一个节点指向bh的上一个节点 */
     if (bh->b_next)
         bh->b_next->b_prev = bh->b_prev;
@@ -263,40 +287,70 @@ static inline void remove_from_queues(struct buffer_head * bh)
     /* hash队列头指向bh的下一个节点 */
     if (hash(bh->b_dev,bh->b_blocknr) == bh)
         hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-    
-/* remove from free list */
-    if (!(bh->b_prev_free) || !(bh->b_next_free))
-        panic("Free block list corrupted");
-
-    /* 让bh 上一个链表指向bh的下一个节点,
-     * 让bh 下一个节点指向bh的上一个节点。
-     * 若bh为头节点, 则让头指针free_list指向bh下一个节点。*/
-    bh->b_prev_free->b_next_free = bh->b_next_free;
-    bh->b_next_free->b_prev_free = bh->b_prev_free;
-    if (free_list == bh)
-        free_list = bh->b_next_free;
+    bh->b_prev = bh->b_next = NULL;
 }
 
-/* [4] insert_into_queues,
- * 将指向相应缓冲区块节点bh加到管理缓冲区的双向循环链表的末尾,
- * 若该节点已关联设备, 则将其加入到hash队列中。*/
-static inline void insert_into_queues(struct buffer_head * bh)
+/* [4] insert_into_hash,
+ * 若缓冲区块节点bh已关联设备, 则将其加入到hash队列头部。*/
+static inline void insert_into_hash(struct buffer_head * bh)
 {
-/* put at end of free list */
-    bh->b_next_free = free_list;
-    bh->b_prev_free = free_list->b_prev_free;
-    free_list->b_prev_free->b_next_free = bh;
-    free_list->b_prev_free = bh;
-/* put the buffer in new hash-queue if it has a device */
     bh->b_prev = NULL;
     bh->b_next = NULL;
     if (!bh->b_dev)
         return;
-    
-    /* 将bh插入到hash(bh->b_dev, bh->blocknr)队列的头部。*/
     bh->b_next = hash(bh->b_dev,bh->b_blocknr);
     hash(bh->b_dev,bh->b_blocknr) = bh;
-    bh->b_next->b_prev = bh;
+    if (bh->b_next)
+        bh->b_next->b_prev = bh;
+}
+
+/* [4.1] remove_from_lru,
+ * 将引用计数即将由0变为1的缓冲区块节点bh从其所在LRU链表中移除。*/
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+    int list = bh->b_list;
+
+    if (!(bh->b_prev_free) || !(bh->b_next_free))
+        panic("Free block list corrupted");
+    if (bh->b_next_free == bh)
+        lru_list[list] = NULL;
+    else {
+        bh->b_prev_free->b_next_free = bh->b_next_free;
+        bh->b_next_free->b_prev_free = bh->b_prev_free;
+        if (lru_list[list] == bh)
+            lru_list[list] = bh->b_next_free;
+    }
+    bh->b_prev_free = bh->b_next_free = NULL;
+    nr_lru[list]--;
+}
+
+/* [4.2] insert_into_lru,
+ * 将引用计数为0的缓冲区块节点bh按其是否已被修改
+ * 加到干净或脏LRU链表的末尾(最近被使用的位置)。*/
+static inline void insert_into_lru(struct buffer_head * bh)
+{
+    struct buffer_head * head;
+    int list = bh->b_dirt ? BUF_DIRTY : BUF_CLEAN;
+
+    bh->b_list = list;
+    nr_lru[list]++;
+    if (!(head = lru_list[list])) {
+        lru_list[list] = bh->b_prev_free = bh->b_next_free = bh;
+        return;
+    }
+    bh->b_next_free = head;
+    bh->b_prev_free = head->b_prev_free;
+    head->b_prev_free->b_next_free = bh;
+    head->b_prev_free = bh;
+}
+
+/* [4.3] refile_buffer,
+ * 写设备完成或缓冲区块被置无效后, 其b_dirt会在脏链表上被复位,
+ * 此处将这样的节点移到与其状态相符的LRU链表末尾。*/
+static inline void refile_buffer(struct buffer_head * bh)
+{
+    remove_from_lru(bh);
+    insert_into_lru(bh);
 }
 
 /* [6] find_buffer,
@@ -335,9 +389,10 @@ struct buffer_head * get_hash_table(int dev, int block)
         if (!(bh=find_buffer(dev,block)))
             return NULL;
         /* 若在hash队列中找到其缓冲区管理节点,
-         * 则增加缓冲区节点的引用计数,
+         * 则增加缓冲区节点的引用计数(被引用的节点不在LRU链表中),
          * 并等待缓冲区块解锁。*/
-        bh->b_count++;
+        if (!bh->b_count++ && !bh->b_mapped)
+            remove_from_lru(bh);
         wait_on_buffer(bh);
         /* 经睡眠等待该缓冲区块管理节点后,
          * 再次检查该缓冲区块的设备号和数据块,
@@ -345,10 +400,92 @@ struct buffer_head * get_hash_table(int dev, int block)
          * 否则表明该缓冲区块竞争失败, 则需减少该缓冲区块的引用计数。*/
         if (bh->b_dev == dev && bh->b_blocknr == block)
             return bh;
-        bh->b_count--;
+        if (!--bh->b_count && !bh->b_mapped)
+            insert_into_lru(bh);
     }
 }
 
+/* [3.1] get_free_buffer,
+ * 从干净LRU链表头部取一个最久未被使用的空闲缓冲区块。
+ *
+ * 干净链表上的节点引用计数都为0, 通常其头节点即可直接使用,
+ * 只有正被预读(READA)而处于上锁状态的节点才需移到链表末尾,
+ * 所以本函数通常只访问一个节点, 不再遍历所有缓冲区块。
+ * 若没有可用的干净缓冲区块则返回NULL, 本函数不会睡眠。*/
+static struct buffer_head * get_free_buffer(void)
+{
+    struct buffer_head * bh;
+    int n = nr_lru[BUF_CLEAN];
+
+    while (n-- > 0 && (bh = lru_list[BUF_CLEAN])) {
+        if (bh->b_dirt) {
+            refile_buffer(bh);
+            continue;
+        }
+        if (!bh->b_lock)
+            return bh;
+        refile_buffer(bh);
+    }
+    return NULL;
+}
+
+/* [3.2] reclaim_dirty,
+ * 干净链表已空时回收脏链表。
+ * 将脏链表上已写回设备(b_dirt已被add_request复位)且已解锁的
+ * 节点移到干净链表中; 若一个也没有, 则开始写回脏链表中最久未被
+ * 使用的缓冲区块所在设备, 并等待该缓冲区块写完。
+ *
+ * 返回0表示脏链表中也没有引用计数为0的缓冲区块。*/
+static int reclaim_dirty(void)
+{
+    struct buffer_head * bh, * next, * busy = NULL;
+    int n = nr_lru[BUF_DIRTY];
+    int moved = 0;
+
+    if (!(bh = lru_list[BUF_DIRTY]))
+        return 0;
+    while (n-- > 0) {
+        next = bh->b_next_free;
+        if (!bh->b_dirt && !bh->b_lock) {
+            refile_buffer(bh);
+            moved++;
+        } else if (!busy)
+            busy = bh;
+        bh = next;
+    }
+    if (moved)
+        return 1;
+    /* 若回写进程已运行, 则唤醒它并睡眠等待其写完一批脏缓冲区块,
+     * 不在本进程中同步整个设备; 回写进程自己或其运行之前则同步写。*/
+    if (bdflush_task && bdflush_task != current) {
+        wake_up(&bdflush_wait);
+        sleep_on_exclusive(&buffer_wait);
+        return 1;
+    }
+    if (busy->b_dirt && !busy->b_lock)
+        sync_dev(busy->b_dev);
+    wait_on_buffer(busy);
+    return 1;
+}
+
+/* [3.3] grow_rd_buffers,
+ * 分配一页内存用作虚拟硬盘缓冲区块管理节点, 加入rd_free_list。
+ * 可能睡眠; 没有空闲内存时返回0。*/
+static int grow_rd_buffers(void)
+{
+    struct buffer_head * bh;
+    unsigned long page;
+
+    if (!(page = get_free_page()))
+        return 0;
+    for (bh = (struct buffer_head *) page ;
+        (unsigned long) (bh+1) <= page + PAGE_SIZE ; bh++) {
+        bh->b_next_free = rd_free_list;
+        rd_free_list = bh;
+    }
+    return 1;
+}
+
 /*
  * Ok, this is getblk, and it isn't very clear, again to hinder
  * race-conditions. Most of the code is seldom used, (ie repeating),
@@ -356,98 +493,76 @@ struct buffer_head * get_hash_table(int dev, int block)
  *
  * The algoritm is changed: hopefully better, and an elusive bug removed.
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 /* [3] getblk,
- * 根据设备号dev和数据块号block获取一块空闲的缓冲区块。*/
+ * 根据设备号dev和数据块号block获取一块空闲的缓冲区块。
+ *
+ * 未命中时从干净LRU链表头取最久未被使用的缓冲区块,
+ * 干净链表为空时才去回收脏链表, 所有缓冲区块都被
+ * 引用时则睡眠等待有缓冲区块被释放。*/
 struct buffer_head * getblk(int dev,int block)
 {
-    struct buffer_head * tmp, * bh;
+    struct buffer_head * bh;
+    char * data;
 
 repeat:
     /* 从dev&&block所映射的hash队列中查找
      * dev&&block缓冲区块的管理节点。*/
     if (bh = get_hash_table(dev,block))
         return bh;
-    
-    /* 若在hash数组管理的队列中没有找到缓冲区块,
-     * 则在双向循环链表中查找一空闲缓冲区块。*/
-    tmp = free_list;
-    do {
-        /* 缓冲区块引用计数不为0则表示其正在被引用 */
-        if (tmp->b_count)
-            continue;
 
-        /* 用bh指向引用计数为0, 且BADNESS值最小的节点,
-         * 引用计数为0时, b_dirt和block即将被原占有者(进程)清0。*/
-        if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-            bh = tmp;
-            
-            /* 若当前节点指向的缓冲区块的BADNESS值为0,
-             * 即b_dirt(未被修改)和block(未上锁)成员皆为0的节点则结束遍历,
-             * 这个状态表明此时bh所指向的缓冲区块完全空闲。*/
-            if (!BADNESS(tmp))
-                break;
+    /* 虚拟硬盘上的数据块直接以虚拟硬盘内存作为缓冲区块,
+     * 其数据总是有效的。grow_rd_buffers可能睡眠, 所以之后回到repeat
+     * 处重新查找; 分配不到内存时仍使用普通缓冲区块。*/
+    if (MAJOR(dev) == 1 && (data = rd_map(dev,block))) {
+        if (bh = rd_free_list) {
+            rd_free_list = bh->b_next_free;
+            bh->b_next_free = NULL;
+            bh->b_data = data;
+            bh->b_mapped = 1;
+            bh->b_count = 1;
+            bh->b_dirt = 0;
+            bh->b_uptodate = 1;
+            bh->b_dev = dev;
+            bh->b_blocknr = block;
+            insert_into_hash(bh);
+            return bh;
         }
-/* and repeat until we find something good */
-    /* 从双向循环链表头节点开始遍历,
-     * 若再遍历到头节点也没有找到指向空闲缓冲区块的节点则结束此次遍历。*/
-    }while ((tmp = tmp->b_next_free) != free_list);
-    /* 若遍历完管理缓冲区块的双向链表
-     * 也没有找到一个引用计数为0的缓冲区块,
+        if (grow_rd_buffers())
+            goto repeat;
+    }
+
+    /* 若在hash数组管理的队列中没有找到缓冲区块,
+     * 则从干净LRU链表中取一空闲缓冲区块。
+     *
+     * 若干净链表和脏链表中都没有引用计数为0的缓冲区块,
      * 则让当前进程睡眠等待(进入阻塞状态),
      * 直到在其它进程释放缓冲区块后再wake_up(&buffer_wait)唤醒,
-     * 然后再重新从repeat处开始试图获取一个指向引用计数为0缓冲区块的节点。
-     *
-     * sleep_on和wake_up是多任务管理(kernel/sched.c)中的函数,
-     * 若跳转阅读二者源码时觉得难以理解则可暂先按照以上描述粗略理解其功能,
-     * 待阅读多任务管理时再与其周旋。*/
-    if (!bh) {
-        sleep_on(&buffer_wait);
+     * 然后再重新从repeat处开始试图获取空闲缓冲区块。
+     * 由于reclaim_dirty可能会睡眠, 所以回收后也回到repeat处。*/
+    if (!(bh = get_free_buffer())) {
+        if (!reclaim_dirty())
+            sleep_on_exclusive(&buffer_wait);
         goto repeat;
     }
 
-    /* 等待引用计数为0的缓冲区被原占有者解锁 */
-    wait_on_buffer(bh);
-
-    /* 在bh所指向缓冲区块解锁后,
-     * 若被其它任务抢先引用则重新回到repeat处寻找引用计数为0的缓冲区块。*/
-    if (bh->b_count)
-        goto repeat;
-
-    /* 若bh所指向缓冲区块中的数据曾被改写过,
-     * 则需在本任务占用该缓冲区块之前将其内数据写回到对应的设备中。
-     * 在将数据写回到对应设备后, 若该缓冲区块被其它任务引用则重新
-     * 回到repeat处寻找引用计数为0的缓冲区块。*/
-    while (bh->b_dirt) {
-        sync_dev(bh->b_dev);
-        wait_on_buffer(bh);
-        if (bh->b_count)
-            goto repeat;
-    }
-    /* NOTE!! While we slept waiting for this block, somebody else might */
-    /* already have added "this" block to the cache. check it */
-    /* 再检查dev&&block对应的缓冲区块的节点是否已被加入到hash表中,
-     * 若已加入到hash表中则回到repeat处尝试从hash表中获取该节点。*/
-    if (find_buffer(dev,block))
-        goto repeat;
     /* OK, FINALLY we know that this buffer is the only one of it's kind, */
     /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
-    /* 如果以上所有检查都没有发生,
-     * 说明本任务所遍历到的完全空闲的缓冲区块
+    /* get_free_buffer不会睡眠, 所以自get_hash_table未命中以来
+     * dev&&block不会被其他任务加入到hash表中, bh完全空闲且干净,
      * 将由本任务获取到并由本任务做该缓冲区块被引用的相关设置。*/
+    remove_from_lru(bh);
     bh->b_count=1;
     bh->b_dirt=0;
     bh->b_uptodate=0;
 
-    /* 将bh节点从hash队列中移除 */
-    remove_from_queues(bh);
+    /* 将bh节点从旧的hash队列中移除 */
+    remove_from_hash(bh);
 
-    /* 设置bh所指向缓冲区块对应的设备分区和设备上的数据块 */
+    /* 设置bh所指向缓冲区块对应的设备分区和设备上的数据块,
+     * 并将该节点加到新的hash队列中。*/
     bh->b_dev=dev;
     bh->b_blocknr=block;
-    /* 将指向空闲缓冲区块节点bh放到双向循环链表末尾,
-     * 并将该节点加到hash队列中。*/
-    insert_into_queues(bh);
+    insert_into_hash(bh);
     return bh;
 }
 
@@ -464,9 +579,18 @@ void brelse(struct buffer_head * buf)
     if (!(buf->b_count--))
         panic("Trying to free free buffer");
 
-    /* 唤醒最近等待缓冲区块管理节点buf解锁的任务,
-     * 这会使得等待buf任务被相继唤醒。*/
-    wake_up(&buffer_wait);
+    /* 引用计数减为0时将其放到对应LRU链表末尾,
+     * 脏缓冲区块过多时唤醒回写进程。
+     * 虚拟硬盘缓冲区块不进入LRU链表。*/
+    if (!buf->b_count && !buf->b_mapped) {
+        insert_into_lru(buf);
+        if (nr_lru[BUF_DIRTY] > NR_BUFFERS/BDFLUSH_DIRTY_RATIO)
+            wake_up(&bdflush_wait);
+    }
+
+    /* 缓冲区块空闲时唤醒一个等待空闲缓冲区块的任务 */
+    if (!buf->b_count)
+        wake_up(&buffer_wait);
 }
 
 /*
@@ -549,16 +673,25 @@ void bread_page(unsigned long address,int dev,int b[4])
     struct buffer_head * bh[4];
     int i;
 
-    /* 将dev&&b[0..3]所对应设备数据读到缓冲区块中,
-     * 缓冲区块首地址存在b[0..3]中。*/
+    /* 为dev&&b[0..3]分配缓冲区块(getblk可能睡眠)。*/
     for (i=0 ; i<4 ; i++)
-        if (b[i]) {
-            if (bh[i] = getblk(dev,b[i]))
-                if (!bh[i]->b_uptodate)
-                    ll_rw_block(READ,bh[i]);
-        } else
+        if (b[i])
+            bh[i] = getblk(dev,b[i]);
+        else
             bh[i] = NULL;
 
+    /* 在堵塞设备请求队列时一并以READA提交读请求, 使相邻的逻辑块
+     * 合并为一个请求, 解除堵塞后再对未能提交的缓冲区块发READ请求。
+     * 对已在读的缓冲区块, ll_rw_block会等其解锁后发现数据已有效而返回。*/
+    plug_device(dev);
+    for (i=0 ; i<4 ; i++)
+        if (bh[i] && !bh[i]->b_uptodate)
+            ll_rw_block(READA,bh[i]);
+    unplug_device(dev);
+    for (i=0 ; i<4 ; i++)
+        if (bh[i] && !bh[i]->b_uptodate)
+            ll_rw_block(READ,bh[i]);
+
     /* 然后将读到缓冲区块的内容拷贝到起始地址为address的内存段中 */
     for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
         if (bh[i]) {
@@ -569,6 +702,57 @@ void bread_page(unsigned long address,int dev,int b[4])
         }
 }
 
+/* [14.1] copy_cached_block,
+ * 若dev&&block对应数据块在缓冲区中且数据有效, 则将其拷贝到to处并
+ * 返回1; 不在缓冲区中或数据无效时返回0; 正在被读写(已上锁)时返回-1。
+ *
+ * 页缓存在从设备直接读数据块到页之前调用本函数, 以缓冲区中(可能
+ * 还未写盘)的数据为准。本函数不会睡眠。*/
+int copy_cached_block(int dev,int block,char * to)
+{
+    struct buffer_head * bh;
+
+    if (!(bh = find_buffer(dev,block)))
+        return 0;
+    if (bh->b_lock)
+        return -1;
+    if (!bh->b_uptodate)
+        return 0;
+    COPYBLK((unsigned long) bh->b_data,(unsigned long) to);
+    return 1;
+}
+
+/* [15.1] bread_ahead,
+ * 预读dev&&block对应数据块到缓冲区块中, 不等待读完成。
+ *
+ * 预读不强求: 若该数据块已在缓冲区中或正在被读, 或没有可直接
+ * 使用的干净缓冲区块, 或块设备请求项不足, 则放弃本次预读。本函
+ * 数不会为预读而睡眠等待缓冲区块, 也不会为预读而写回脏缓冲区块。*/
+void bread_ahead(int dev,int block)
+{
+    struct buffer_head * bh;
+
+    if (bh = find_buffer(dev,block)) {
+        if (!bh->b_uptodate && !bh->b_lock && !bh->b_count)
+            ll_rw_block(READA,bh);
+        return;
+    }
+    if (!(bh = get_free_buffer()))
+        return;
+    remove_from_lru(bh);
+    bh->b_count=1;
+    bh->b_dirt=0;
+    bh->b_uptodate=0;
+    remove_from_hash(bh);
+    bh->b_dev=dev;
+    bh->b_blocknr=block;
+    insert_into_hash(bh);
+
+    ll_rw_block(READA,bh);
+    bh->b_count=0;
+    insert_into_lru(bh);
+}
+
 /*
  * Ok, breada can be used as bread, but additionally to mark other
  * blocks for reading as well. End the argument list with a negative
@@ -582,7 +766,7 @@ void bread_page(unsigned long address,int dev,int b[4])
 struct buffer_head * breada(int dev,int first, ...)
 {
     va_list args;
-    struct buffer_head * bh, *tmp;
+    struct buffer_head * bh;
 
     va_start(args,first);
 
@@ -595,15 +779,10 @@ struct buffer_head * breada(int dev,int first, ...)
 
     /* 若之后还跟有数据块号参数, 则预读这些数据块号对应的数据。
      * 预读是指可以顺利阅读则顺便读了, 不能顺利读也不强求,
-     * 具体含义待阅读外设程序时再进一步理解吧。*/
-    while ((first=va_arg(args,int))>=0) {
-        tmp=getblk(dev,first);
-        if (tmp) {
-            if (!tmp->b_uptodate)
-                ll_rw_block(READA,bh); /* 应该是tmp? */
-            tmp->b_count--;
-        }
-    }
+     * 具体含义待阅读外设程序时再进一步理解吧。
+     * (原来此处对bh而非tmp发起READA, 预读从未生效。)*/
+    while ((first=va_arg(args,int))>=0)
+        bread_ahead(dev,first);
     va_end(args);
     wait_on_buffer(bh);
 
@@ -615,6 +794,84 @@ struct buffer_head * breada(int dev,int first, ...)
     brelse(bh);
     return (NULL);
 }
+/* bdflush_timeout,
+ * 回写周期定时器超时回调函数, 在定时器中断中唤醒回写进程。*/
+static void bdflush_timeout(unsigned long unused)
+{
+    wake_up(&bdflush_wait);
+}
+
+static struct timer_list bdflush_timer = { NULL, NULL, 0, 0, bdflush_timeout };
+
+/* sort_buffers,
+ * 以(设备号,逻辑块号)升序对list中的n个缓冲区块节点进行希尔排序,
+ * 使回写请求按块顺序提交以便在请求队列中合并。*/
+static void sort_buffers(struct buffer_head ** list, int n)
+{
+    struct buffer_head * bh;
+    int gap, i, j;
+
+#define BH_LESS(a,b) ((a)->b_dev < (b)->b_dev || \
+    ((a)->b_dev == (b)->b_dev && (a)->b_blocknr < (b)->b_blocknr))
+    for (gap = n/2 ; gap > 0 ; gap /= 2)
+        for (i = gap ; i < n ; i++) {
+            bh = list[i];
+            for (j = i ; j >= gap && BH_LESS(bh,list[j-gap]) ; j -= gap)
+                list[j] = list[j-gap];
+            list[j] = bh;
+        }
+#undef BH_LESS
+}
+
+/* [16] sys_bdflush,
+ * 回写守护进程的主体, 由init创建的子进程调用且永不返回。
+ *
+ * 每个回写周期或被唤醒时, 先将内存中修改过的i节点同步到缓冲区,
+ * 再从脏LRU链表中收集引用计数为0的脏缓冲区块(顺便将已写完的节点
+ * 移回干净链表), 按块顺序排序后提交写请求并等待写完, 最后唤醒等待
+ * 空闲缓冲区块的进程。这样getblk在读路径上只需从干净链表中取缓冲
+ * 区块, 不再为一个脏缓冲区块同步整个设备。*/
+int sys_bdflush(void)
+{
+    struct buffer_head ** list, * bh, * next;
+    int i, n, nr;
+
+    if (!suser())
+        return -EPERM;
+    if (bdflush_task)
+        return -EBUSY;
+    if (!(list = (struct buffer_head **) get_free_page()))
+        return -ENOMEM;
+    bdflush_task = current;
+    for (;;) {
+        sync_inodes();
+        n = 0;
+        nr = nr_lru[BUF_DIRTY];
+        bh = lru_list[BUF_DIRTY];
+        while (nr-- > 0 && n < PAGE_SIZE/sizeof(*list)) {
+            next = bh->b_next_free;
+            if (!bh->b_dirt) {
+                if (!bh->b_lock)
+                    refile_buffer(bh);
+            } else if (!bh->b_lock)
+                list[n++] = bh;
+            bh = next;
+        }
+        sort_buffers(list,n);
+        for (i = 0 ; i < n ; i++)
+            ll_rw_block(WRITE,list[i]);
+        for (i = 0 ; i < n ; i++)
+            wait_on_buffer(list[i]);
+        wake_up_all(&buffer_wait);
+        /* 写完一批后脏缓冲区块仍过多则立即开始下一批 */
+        if (n && nr_lru[BUF_DIRTY] > NR_BUFFERS/BDFLUSH_DIRTY_RATIO)
+            continue;
+        if (!timer_pending(&bdflush_timer))
+            mod_timer(&bdflush_timer,jiffies+BDFLUSH_INTERVAL);
+        sleep_on(&bdflush_wait);
+    }
+}
+
 /* 缓冲区管理程序与多任务管理, 外设管理, 文件管理程序都有交织,
  * 不过此文并没有过多深入到这几个模块中去阅读相应程序源码,
  * 而是用粗略概括相应函数功能的方式衔接相应缓冲区管理函数的功能。
@@ -664,12 +921,13 @@ struct buffer_head * breada(int dev,int first, ...)
 void buffer_init(long buffer_end)
 {
     /* start_buffer为buffer开始处,
-     * 管理buffer的双向链表数据结构位于buffer最前面。
+     * hash数组和管理buffer的双向链表数据结构位于buffer最前面。
      *
      * 双向链表的节点类型为struct buffer_head,
      * 该接头体类型定义在include/linux/fs.h文件中。*/
-    struct buffer_head * h = start_buffer;
+    struct buffer_head * h;
     void * b;
+    unsigned long size;
     int i;
 
     /* 若buffer结束地址为1Mb处, 则buffer末尾为640Kb处;
@@ -680,6 +938,21 @@ void buffer_init(long buffer_end)
     else
         b = (void *) buffer_end;
 
+    /* 估算缓冲区块数(需除去[A0000h, 100000h)), 并以不小于
+     * 该数的2的幂作为hash数组大小, 使hash队列平均长度不超过1。
+     * hash数组放在buffer开始处, 缓冲区块管理节点紧随其后。*/
+    size = (unsigned long) b - (unsigned long) &end;
+    if ((unsigned long) b > 0x100000)
+        size -= 0x100000 - 0xA0000;
+    size /= BLOCK_SIZE + sizeof(struct buffer_head);
+    for (hash_mask = 16 ; hash_mask < size ; hash_mask <<= 1)
+        /* nothing */ ;
+    hash_table = (struct buffer_head **) &end;
+    for (i=0 ; i<hash_mask ; i++)
+        hash_table[i] = NULL;
+    start_buffer = h = (struct buffer_head *) (hash_table + hash_mask);
+    hash_mask--;
+
     /* BLOCK_SIZE=1024即1Kb(include/linux/fs.h),
      * 链表中的一个节点 管理1Kb大小的缓冲区块。*/
     while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
@@ -688,12 +961,14 @@ void buffer_init(long buffer_end)
         h->b_count = 0; /* 当前节点所指缓冲区块的引用计数 */
         h->b_lock = 0;  /* 当前节点所指缓冲区块是否上锁(0-未锁, 1-已上锁) */
         h->b_uptodate = 0; /* 当前节点所指缓冲区块数据是否(0-无数据, 1-有数据) */
+        h->b_mapped = 0;   /* 当前节点所指缓冲区块位于buffer中 */
         h->b_wait = NULL;  /* 指向在等待 当前节点所指缓冲区块 释放锁的任务/进程 */
         h->b_next = NULL;  /* 指向与当前节点具相同hash值的下一节点 */
         h->b_prev = NULL;  /* 指向与当前节点具相同hash值的上一节点 */
         h->b_data = (char *) b; /* 当前节点所指缓冲区内存块 */
         h->b_prev_free = h-1;   /* 指向链表中的上一个节点 */
         h->b_next_free = h+1;   /* 指向链表中的下一个节点 */
+        h->b_list = BUF_CLEAN;  /* 初始时所有缓冲区块都在干净LRU链表中 */
         h++; /* 使用下一块大小为(struct buffer_head)内存用作下一个链表节点 */
         NR_BUFFERS++; /* 更新缓冲区块的数量 */
 
@@ -703,18 +978,17 @@ void buffer_init(long buffer_end)
         b = (void *) 0xA0000;
     }
 
-    /* 用链表节点指针类型(struct buffer_head *)的全局变量free_list
-     * 指向链表首节点;让首节点指向上一个链表节点的成员指针指向链表
-     * 中的最后一个节点, 让链表最后一个节点的指向下一个链表节点的
-     * 成员指针指向链表首节点, 即完成双向循环链表。*/
+    /* 用lru_list[BUF_CLEAN]指向链表首节点;让首节点指向上一个链表
+     * 节点的成员指针指向链表中的最后一个节点, 让链表最后一个节点的
+     * 指向下一个链表节点的成员指针指向链表首节点, 即完成双向循环链表。
+     * 脏链表初始为空。*/
     h--;
-    free_list = start_buffer;
-    free_list->b_prev_free = h;
-    h->b_next_free = free_list;
-
-    /* 将类型为(struct buffer_head *)的全局指针数组hash_table初始化为NULL。*/
-    for (i=0;i<NR_HASH;i++)
-        hash_table[i]=NULL;
+    lru_list[BUF_CLEAN] = start_buffer;
+    lru_list[BUF_CLEAN]->b_prev_free = h;
+    h->b_next_free = lru_list[BUF_CLEAN];
+    lru_list[BUF_DIRTY] = NULL;
+    nr_lru[BUF_CLEAN] = NR_BUFFERS;
+    nr_lru[BUF_DIRTY] = 0;
 }	
 /* 先不管hash_table的作用吧,
  * 希望能在buffer.c中的其余函数中慢慢明白hash_table的作用。
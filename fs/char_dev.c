@@ -10,6 +10,8 @@
 #include <linux/sched.h>
 #include <linux/kernel.h>
 
+#include <linux/blktrace.h>
+
 #include <asm/segment.h>
 #include <asm/io.h>
 
@@ -106,6 +108,8 @@ static int rw_memory(int rw, unsigned minor, char * buf, int count, off_t * pos)
             return (rw==READ)?0:count;  /* rw_null */
         case 4:
             return rw_port(rw,buf,count,pos);
+        case 5:
+            return rw_blktrace(rw,buf,count); /* 块设备请求跟踪 */
         default:
             return -EIO;
     }
@@ -281,17 +281,17 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 }
 
 /* change_ldt,
- * 更改当前进程的LDT,使其代码段限长为text_size,数据段限长为64Mb;
+ * 更改当前进程的LDT,使其代码段限长为text_size,数据段限长为TASK_SIZE;
  * 将进程数据段末端与page中保存环境变量和命令行等参数的内存页映射。*/
 static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 {
     unsigned long code_limit,data_limit,code_base,data_base;
     int i;
 
-    /* 代码段以页对齐;数据段大小为64Mb */
+    /* 代码段以页对齐;数据段大小为TASK_SIZE */
     code_limit = text_size+PAGE_SIZE -1;
     code_limit &= 0xFFFFF000;
-    data_limit = 0x4000000;
+    data_limit = TASK_SIZE;
 
     /* 基于当前进程代码段和数据段基址和所计算的限长,设置新的LDT表 */
     code_base = get_base(current->ldt[1]);
@@ -492,7 +492,7 @@ restart_interp:
     brelse(bh);
 /* 解析可执行文件头部 */
     if (N_MAGIC(ex) != ZMAGIC || ex.a_trsize || ex.a_drsize ||
-        ex.a_text+ex.a_data+ex.a_bss>0x3000000 ||
+        ex.a_text+ex.a_data+ex.a_bss>TASK_SIZE/4*3 ||
         inode->i_size < ex.a_text+ex.a_data+ex.a_syms+N_TXTOFF(ex)) {
         retval = -ENOEXEC;
         goto exec_error2;
@@ -6,50 +6,162 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/mm.h>
 #include <asm/segment.h>
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
-/* file_read,
- * 从inode所指i节点对应文件当前位置读取count字节到buf内存段中。
- * 函数返回读取成功的字节数,若读取0字节则返回错误号。*/
-int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
+/* 预读窗口的初始大小和最大大小(逻辑块数)。
+ * 最大窗口不宜超过硬盘请求项池基本大小(NR_REQUEST)的一半,
+ * 否则预读请求会挤占其他读写请求的请求项。
+ * RA_BATCH为一次最多提交的预读逻辑块数。*/
+#define RA_MIN_WINDOW 4
+#define RA_MAX_WINDOW 16
+#define RA_BATCH 32
+
+/* file_ra_update,
+ * 在每次读开始时更新filp的预读窗口。
+ * 若本次读从上次读结束的位置开始则视为顺序读, 预读窗口在
+ * [RA_MIN_WINDOW, RA_MAX_WINDOW]内按倍数增长; 否则视为随机读,
+ * 预读窗口清0, 只预读本次读所覆盖的逻辑块。*/
+static void file_ra_update(struct file * filp)
+{
+    if (filp->f_pos == filp->f_ra_pos) {
+        if (!filp->f_ra_win)
+            filp->f_ra_win = RA_MIN_WINDOW;
+        else if (filp->f_ra_win < RA_MAX_WINDOW)
+            filp->f_ra_win <<= 1;
+    } else {
+        filp->f_ra_win = 0;
+        filp->f_ra_end = 0;
+    }
+}
+
+/* file_readahead,
+ * 在从filp当前位置所在页读取数据之前, 为其后直到last加预读窗口
+ * 大小个逻辑块(不超过文件末尾和RA_BATCH)所在的页提交预读请求,
+ * 已提交过预读的逻辑块不再重复提交。预读以页为单位, 数据直接读入
+ * 页缓存中的页(见mm/filemap.c)。
+ *
+ * 各页先由prepare_cache_page()分配并映射其逻辑块(bmap可能读间接块
+ * 而睡眠), 然后在堵塞设备请求队列的情况下以READA方式一并提交, 使
+ * 相邻逻辑块合并为一个请求, 最后解除堵塞启动设备。*/
+static void file_readahead(struct m_inode * inode, struct file * filp,
+    unsigned long last)
+{
+    unsigned long block, end;
+    struct cache_page * p[RA_BATCH/PAGE_BLOCKS];
+    int i, n = 0;
+
+    if (filp->f_pos >= inode->i_size)
+        return;
+    block = (filp->f_pos / BLOCK_SIZE) & ~(PAGE_BLOCKS-1);
+    end = MIN(last + filp->f_ra_win, block + RA_BATCH);
+    end = MIN(end, (inode->i_size - 1) / BLOCK_SIZE);
+    /* 当前页会被立即读入, 从其后一页开始预读 */
+    block = MAX(block + PAGE_BLOCKS, filp->f_ra_end);
+    if (block > end)
+        return;
+    filp->f_ra_end = (end | (PAGE_BLOCKS-1)) + 1;
+    for ( ; block <= end ; block += PAGE_BLOCKS)
+        if (p[n] = prepare_cache_page(inode,block))
+            n++;
+    if (!n)
+        return;
+    plug_device(inode->i_dev);
+    for (i = 0 ; i < n ; i++)
+        start_cache_page(p[i]);
+    unplug_device(inode->i_dev);
+    for (i = 0 ; i < n ; i++)
+        release_cache_page(p[i]);
+}
+
+/* file_read_buffers,
+ * 经缓冲区块从filp当前位置读取count字节到buf中, 返回读取的字节数。
+ * 用于不经页缓存的文件: 目录, 其块只经缓冲区块修改(见namei.c);
+ * 虚拟硬盘上的文件, 其缓冲区块直接指向虚拟硬盘内存, 数据只从虚拟
+ * 硬盘拷贝一次到buf中。文件空洞处读出0。*/
+static int file_read_buffers(struct m_inode * inode, struct file * filp,
+    char * buf, int count)
 {
     int left,chars,nr;
     struct buffer_head * bh;
 
-    if ((left=count)<=0)
-        return 0;
-    
+    left = count;
     while (left) {
-        /* 将文件当前偏移换算为逻辑块单位,获取其逻辑块号nr;
-         * 读取inode所指i节点逻辑块号为nr的逻辑块到缓冲区块中。*/
         if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
             if (!(bh=bread(inode->i_dev,nr)))
                 break;
         } else
             bh = NULL;
-        /* 计算能从当前缓冲区块中获取数据的最大字节数,
-         * 后移文件偏移及剩余未读字节数。*/
         nr = filp->f_pos % BLOCK_SIZE;
         chars = MIN( BLOCK_SIZE-nr , left );
         filp->f_pos += chars;
         left -= chars;
-        if (bh) { /* 将所读内容拷贝到出参buf中 */
-            char * p = nr + bh->b_data;
-            while (chars-->0)
-                put_fs_byte(*(p++),buf++);
+        if (bh) {
+            memcpy_tofs(buf,nr+bh->b_data,chars);
+            buf += chars;
             brelse(bh);
-        } else { /* 否则往buf内存段中填0 */
+        } else {
             while (chars-->0)
                 put_fs_byte(0,buf++);
         }
     }
-    /* 修改i节点最后访问时间 */
+    return count-left;
+}
+
+/* file_read,
+ * 从inode所指i节点对应文件当前位置读取count字节到buf内存段中。
+ * 函数返回读取成功的字节数,若读取0字节则返回错误号。*/
+int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
+{
+    int left,chars,nr;
+    unsigned long last;
+    struct cache_page * page;
+
+    if ((left=count)<=0)
+        return 0;
+
+    /* 页缓存只缓存普通文件。目录项由namei.c直接在缓冲区块中增删,
+     * 不经页缓存, 所以目录经缓冲区块读, 以免读到过时的目录项; 虚拟
+     * 硬盘上的文件也不经页缓存。两者都无需预读。*/
+    if (!S_ISREG(inode->i_mode) || !PAGE_CACHED(inode->i_dev)) {
+        left -= file_read_buffers(inode,filp,buf,left);
+        inode->i_atime = CURRENT_TIME;
+        return (count-left)?(count-left):-ERROR;
+    }
+
+    /* 根据本次读是否为顺序读调整预读窗口, 在逐页读之前提交本
+     * 次读及其后窗口内逻辑块的预读请求, 使读尽量命中已在读的页。*/
+    file_ra_update(filp);
+    last = (filp->f_pos + count - 1) / BLOCK_SIZE;
+
+    while (left) {
+        file_readahead(inode,filp,last);
+        /* 从页缓存中获取文件当前偏移所在页, 页中的逻辑块由块设备
+         * 直接读入, 文件空洞处为0。*/
+        nr = (filp->f_pos / BLOCK_SIZE) & ~(PAGE_BLOCKS-1);
+        if (!(page = find_cache_page(inode,nr)))
+            break;
+        /* 计算能从当前页中获取数据的最大字节数,
+         * 后移文件偏移及剩余未读字节数。*/
+        nr = filp->f_pos % PAGE_SIZE;
+        chars = MIN( PAGE_SIZE-nr , left );
+        filp->f_pos += chars;
+        left -= chars;
+        /* 将所读内容拷贝到出参buf中 */
+        memcpy_tofs(buf,nr + (char *) page->p_page,chars);
+        buf += chars;
+        release_cache_page(page);
+    }
+    /* 记录本次读结束的位置以供下次读判断是否为顺序读;
+     * 修改i节点最后访问时间。*/
+    filp->f_ra_pos = filp->f_pos;
     inode->i_atime = CURRENT_TIME;
     return (count-left)?(count-left):-ERROR;
 }
@@ -95,9 +207,11 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
         }
         i += c; /* 已写入字节数更新 */
         
-        /* 将buf内存段中的内容拷贝到缓冲区块 */
-        while (c-->0)
-            *(p++) = get_fs_byte(buf++);
+        /* 将buf内存段中的内容拷贝到缓冲区块,
+         * 再将所写内容同步到页缓存中包含该块的页。*/
+        memcpy_fromfs(p,buf,c);
+        buf += c;
+        update_cache_page(inode,(pos-c)/BLOCK_SIZE,(pos-c)%BLOCK_SIZE,p,c);
         brelse(bh);
     }
     /* 修改文件最后被修改时间;
@@ -37,7 +37,7 @@ static inline void lock_inode(struct m_inode * inode)
 /* 同lock_super */
     cli();
     while (inode->i_lock)
-        sleep_on(&inode->i_wait);
+        sleep_on_exclusive(&inode->i_wait);
     inode->i_lock=1;
     sti();
 }
@@ -46,8 +46,8 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
         PIPE_TAIL(*inode) += chars;
         PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
         /* 将管道中的数据拷贝到buf内存段中 */
-        while (chars-->0)
-            put_fs_byte(((char *)inode->i_size)[size++],buf++);
+        memcpy_tofs(buf,size + (char *)inode->i_size,chars);
+        buf += chars;
     }
     /* 读取完毕后唤醒写管道进程 */
     wake_up(&inode->i_wait);
@@ -89,8 +89,8 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
         PIPE_HEAD(*inode) += chars;
         PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
         /* 将buf内存段中的数据写入管道中 */
-        while (chars-->0)
-            ((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+        memcpy_fromfs(size + (char *)inode->i_size,buf,chars);
+        buf += chars;
     }
     /* 写入完毕唤醒读管道的进程 */
     wake_up(&inode->i_wait);
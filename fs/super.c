@@ -341,6 +341,8 @@ int sys_umount(char * dev_name)
     sb->s_isup = NULL;
     put_super(dev);
     sync_dev(dev);
+    /* 该设备上的文件已都不再被引用, 丢弃其在页缓存中的页 */
+    invalidate_cache_pages(dev,0);
     return 0;
 }
 
@@ -65,6 +65,9 @@ void truncate(struct m_inode * inode)
     if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
         return;
 
+    /* 先丢弃该文件在页缓存中的页, 其逻辑块释放后可能分给其他文件 */
+    invalidate_cache_pages(inode->i_dev,inode->i_num);
+
     /* 释放inode所指i节点的逻辑块,
      * 清保存数据逻辑块号的数组。*/
     for (i=0;i<7;i++)
@@ -68,3 +68,14 @@ __asm__ volatile ("inb %%dx,%%al\n" \
     "1:":"=a" (_v):"d" (port)); \
 _v; \
 })
+
+/* outl(value,port), inl(port),
+ * 同outb和inb, 以4字节为单位读写端口, 如PCI配置空间端口0xCF8/0xCFC。*/
+#define outl(value,port) \
+__asm__ ("outl %%eax,%%dx"::"a" (value),"d" (port))
+
+#define inl(port) ({ \
+unsigned long _v; \
+__asm__ volatile ("inl %%dx,%%eax":"=a" (_v):"d" (port)); \
+_v; \
+})
@@ -58,6 +58,51 @@ extern inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/* memcpy_fromfs,
+ * 将用户内存地址from处的n字节拷贝到内核内存地址to处。
+ *
+ * 先按n的最低两位拷贝1字节和2字节, 余下部分以4字节为单位
+ * 由rep movsl拷贝。源操作数ds:esi可用fs段前缀替换为fs:esi。
+ * 拷贝中的缺页与get_fs_byte一样由缺页处理程序处理。*/
+extern inline void memcpy_fromfs(void * to, const void * from, unsigned long n)
+{
+__asm__("cld\n\t"
+    "testb $1,%%cl\n\t"
+    "je 1f\n\t"
+    "fs ; movsb\n"
+    "1:\ttestb $2,%%cl\n\t"
+    "je 2f\n\t"
+    "fs ; movsw\n"
+    "2:\tshrl $2,%%ecx\n\t"
+    "rep ; fs ; movsl"
+    ::"c" (n),"D" ((long) to),"S" ((long) from)
+    :"cx","di","si","memory");
+}
+
+/* memcpy_tofs,
+ * 将内核内存地址from处的n字节拷贝到用户内存地址to处。
+ *
+ * 目的操作数es:edi不能使用段前缀, 所以拷贝期间将es临时设置为fs,
+ * 拷贝完成后恢复es。拷贝方式同memcpy_fromfs。*/
+extern inline void memcpy_tofs(void * to, const void * from, unsigned long n)
+{
+__asm__("cld\n\t"
+    "push %%es\n\t"
+    "push %%fs\n\t"
+    "pop %%es\n\t"
+    "testb $1,%%cl\n\t"
+    "je 1f\n\t"
+    "movsb\n"
+    "1:\ttestb $2,%%cl\n\t"
+    "je 2f\n\t"
+    "movsw\n"
+    "2:\tshrl $2,%%ecx\n\t"
+    "rep ; movsl\n\t"
+    "pop %%es"
+    ::"c" (n),"D" ((long) to),"S" ((long) from)
+    :"cx","di","si","memory");
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the followig.
  * It seems to work, but I don't know if I'm doing something subtly wrong.
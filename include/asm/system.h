@@ -57,6 +57,15 @@ __asm__ ("movl %%esp,%%eax\n\t" \
 #define cli() __asm__ ("cli"::)
 #define nop() __asm__ ("nop"::)
 
+/* save_flags(x), restore_flags(x),
+ * 保存标志寄存器到x中; 从x恢复标志寄存器(含中断允许标志)。
+ * 用于可能在中断中被调用的函数: 以save_flags(x);cli();...;restore_flags(x);
+ * 代替cli();...;sti();, 不会在中断处理中途开启中断。*/
+#define save_flags(x) \
+__asm__ __volatile__("pushfl ; popl %0":"=r" (x)::"memory")
+#define restore_flags(x) \
+__asm__ __volatile__("pushl %0 ; popfl"::"r" (x):"memory")
+
 /* 中断返回指令。*/
 #define iret() __asm__ ("iret"::)
 
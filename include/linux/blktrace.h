@@ -0,0 +1,34 @@
+#ifndef _BLKTRACE_H
+#define _BLKTRACE_H
+
+/* 块设备请求跟踪(见kernel/blk_drv/blktrace.c)。
+ * 跟踪事件由字符设备(主设备号1, 次设备号5)读出, 主机上的
+ * tools/blkparse将其整理为寻道和延迟报告。*/
+
+/* 事件类型 */
+#define BT_QUEUE    1 /* 缓冲区块以新请求入队(make_request) */
+#define BT_MERGE    2 /* 缓冲区块并入已在队列中的请求(make_request) */
+#define BT_DISPATCH 3 /* 驱动程序向设备下发读写命令(do_hd_request等) */
+#define BT_COMPLETE 4 /* 缓冲区块传输结束(end_request) */
+#define BT_LOST     5 /* 跟踪缓冲区溢出, sector为丢失的事件数 */
+
+/* struct blk_trace_event,
+ * 一个跟踪事件, 16字节。
+ * sector为设备分区中的扇区号, nr_sectors为扇区数;
+ * pid为事件发生时的当前进程, 对在中断中记录的事件(下发、结束)无意义;
+ * time为以微秒计的时刻(见blk_clock), 只用于求差值。*/
+struct blk_trace_event {
+    unsigned long time;
+    unsigned long sector;
+    unsigned short dev;
+    unsigned char action;
+    unsigned char cmd;        /* READ或WRITE */
+    unsigned short nr_sectors;
+    short pid;
+};
+
+extern void blk_trace(int action, int dev, int cmd,
+    unsigned long sector, int nr_sectors);
+extern int rw_blktrace(int rw, char * buf, int count);
+
+#endif
@@ -7,6 +7,7 @@
 #define _FS_H
 
 #include <sys/types.h>
+#include <linux/wait.h>
 
 /* devices are as follows: (same as minix, so we can use the minix
  * file system. These are major numbers.)
@@ -58,7 +59,6 @@ void buffer_init(long buffer_end);
 #define NR_INODE 32 /* i节点在内存中同时能缓存的最大个数 */
 #define NR_FILE 64  /* 系统可同时打开文件的最大个数 */
 #define NR_SUPER 8  /* 超级块在内存中同时能缓存的最大个数 */
-#define NR_HASH 307 /* 缓冲区块全局hash数组元素个数 */
 #define NR_BUFFERS nr_buffers /* 缓冲区块buffer数 */
 #define BLOCK_SIZE 1024       /* 缓冲区块大小, 1024字节即1Kb */
 #define BLOCK_SIZE_BITS 10    /* 缓冲区块大小对应的bit位数 */
@@ -85,6 +85,14 @@ void buffer_init(long buffer_end);
 #define INC_PIPE(head) \
 __asm__("incl %0\n\tandl $4095,%0"::"m" (head))
 
+/* 缓冲区块LRU链表类型。
+ * 引用计数为0的缓冲区块按其数据是否已被修改分别挂在
+ * 干净链表或脏链表上,链表头为最久未被使用的缓冲区块;
+ * 被引用的缓冲区块不在任何LRU链表中。*/
+#define BUF_CLEAN 0
+#define BUF_DIRTY 1
+#define NR_LIST 2
+
 /* 缓冲区块? 似乎没有在程序中使用 */
 typedef char buffer_block[BLOCK_SIZE];
 
@@ -98,11 +106,42 @@ struct buffer_head {
     unsigned char b_dirt;     /* 0-clean,1-dirty */
     unsigned char b_count;    /* users using this block */
     unsigned char b_lock;     /* 0 - ok, 1 -locked */
-    struct task_struct * b_wait; /* 用于各进程互斥访问缓冲区块 */
+    struct wait_queue * b_wait; /* 用于各进程互斥访问缓冲区块 */
     struct buffer_head * b_prev; /* 指向与当前节点具相同hash值的上一节点 */
     struct buffer_head * b_next; /* 指向与当前节点具相同hash值的下一节点 */
-    struct buffer_head * b_prev_free; /* 指向链表中上一节点 */
-    struct buffer_head * b_next_free; /* 指向链表中下一节点 */
+    struct buffer_head * b_prev_free; /* 指向LRU链表中上一节点 */
+    struct buffer_head * b_next_free; /* 指向LRU链表中下一节点 */
+    unsigned char b_list;     /* 所在LRU链表, BUF_CLEAN or BUF_DIRTY */
+    struct buffer_head * b_reqnext; /* 同一块设备请求中的下一个缓冲区块 */
+    unsigned char b_mapped;   /* b_data直接指向虚拟硬盘内存, 不在LRU链表中 */
+};
+
+/* 一页内存所含逻辑块数(PAGE_SIZE/BLOCK_SIZE) */
+#define PAGE_BLOCKS 4
+
+/* PAGE_CACHED(dev),
+ * 设备dev上的文件数据是否经页缓存读。虚拟硬盘的缓冲区块直接指向
+ * 虚拟硬盘内存, 其上的文件经缓冲区块读, 不再在页缓存中另存一份。*/
+#define PAGE_CACHED(dev) (MAJOR(dev) != 1)
+
+/* struct cache_page,
+ * 页缓存项, 描述页缓存(mm/filemap.c)中的一页文件数据。
+ * 以(设备号, i节点号, 页中首个逻辑块在文件中的块号)标识。
+ * p_bh不在缓冲区中, 只作为直接读逻辑块到页中的I/O描述,
+ * 其b_data指向页中相应的1Kb, b_blocknr为0表示文件空洞。*/
+struct cache_page {
+    unsigned long p_page;     /* 页内存首地址 */
+    unsigned short p_dev;     /* 文件所在设备号 */
+    unsigned short p_ino;     /* 文件i节点号 */
+    unsigned long p_block;    /* 页中首个逻辑块在文件中的块号 */
+    unsigned short p_count;   /* 引用计数 */
+    unsigned char p_uptodate; /* 页中数据有效 */
+    unsigned char p_hashed;   /* 在页缓存hash表中 */
+    struct buffer_head p_bh[PAGE_BLOCKS];
+    struct cache_page * p_prev; /* hash队列中上一项 */
+    struct cache_page * p_next; /* hash队列中下一项 */
+    struct cache_page * p_prev_lru; /* 未被引用页LRU链表中上一项 */
+    struct cache_page * p_next_lru; /* 未被引用页LRU链表中下一项 */
 };
 
 /* struct d_inode,
@@ -193,7 +232,7 @@ struct m_inode {
 
     /* 用于多进程间对本i节点或对应文件的互斥访问,
      * <sleep_on + wake_up>。*/
-    struct task_struct * i_wait;
+    struct wait_queue * i_wait;
 
     /* i节点最后被访问时间 */
     unsigned long i_atime;
@@ -238,6 +277,9 @@ struct file {
     unsigned short f_count;   /* 文件引用计数 */
     struct m_inode * f_inode; /* 指向文件的i节点 */
     off_t f_pos; /* 访问文件的当前位置 */
+    off_t f_ra_pos;          /* 上次读结束时的文件位置,用于判断是否为顺序读 */
+    unsigned long f_ra_end;  /* 已提交预读的最后一个文件内逻辑块号+1 */
+    unsigned short f_ra_win; /* 当前预读窗口大小(逻辑块数) */
 };
 
 
@@ -306,7 +348,7 @@ struct super_block {
 
     /* 用于进程对超级块的互斥访问,
      * <sleep_on + wake_up>。*/
-    struct task_struct * s_wait;
+    struct wait_queue * s_wait;
 
     /* 超级块的上锁标志, 0-未上锁, 1-已上锁 */
     unsigned char s_lock;
@@ -348,6 +390,7 @@ extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
+extern int nr_lru[NR_LIST];
 
 extern void check_disk_change(int dev);
 extern int floppy_change(unsigned int nr);
@@ -369,10 +412,25 @@ extern struct m_inode * get_pipe_inode(void);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern char * rd_map(int dev, int block);
+extern void plug_device(int dev);
+extern void unplug_device(int dev);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
+extern void bread_ahead(int dev,int block);
+extern int copy_cached_block(int dev,int block,char * to);
+extern struct cache_page * find_cache_page(struct m_inode * inode,
+    unsigned long block);
+extern struct cache_page * prepare_cache_page(struct m_inode * inode,
+    unsigned long block);
+extern void start_cache_page(struct cache_page * p);
+extern void release_cache_page(struct cache_page * p);
+extern void update_cache_page(struct m_inode * inode, unsigned long block,
+    int offset, char * data, int count);
+extern void invalidate_cache_pages(int dev, int ino);
+extern int shrink_cache_pages(void);
 extern int new_block(int dev);
 extern void free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
@@ -56,6 +56,23 @@
 #define WIN_SEEK     0x70 /* 寻道 */
 #define WIN_DIAGNOSE 0x90 /* 控制器诊断 */
 #define WIN_SPECIFY  0x91 /* 建立驱动器参数 */
+#define WIN_MULTREAD  0xC4 /* 多扇区读, 每次中断传输一组扇区 */
+#define WIN_MULTWRITE 0xC5 /* 多扇区写 */
+#define WIN_SETMULT   0xC6 /* 设置多扇区读写每组的扇区数 */
+#define WIN_READDMA   0xC8 /* DMA读 */
+#define WIN_WRITEDMA  0xCA /* DMA写 */
+#define WIN_IDENTIFY  0xEC /* 读取驱动器标识信息(struct hd_driveid) */
+
+/* LBA48寻址的读写命令 */
+#define WIN_READ_EXT      0x24
+#define WIN_READDMA_EXT   0x25
+#define WIN_MULTREAD_EXT  0x29
+#define WIN_WRITE_EXT     0x34
+#define WIN_WRITEDMA_EXT  0x35
+#define WIN_MULTWRITE_EXT 0x39
+
+/* 驱动器/磁头寄存器(HD_CURRENT)中的LBA寻址位 */
+#define LBA_FLAG 0x40
 
 /* Bits for HD_ERROR */
 /* 读0x1f1-读错误寄存器,其各位含义。
@@ -88,4 +105,49 @@ struct partition {
     unsigned int nr_sects;    /* 分区占用扇区数 */
 };
 
+/* struct hd_driveid,
+ * WIN_IDENTIFY命令返回的驱动器标识信息(256字), 只列出用到的字段。*/
+struct hd_driveid {
+    unsigned short config;        /* 0 */
+    unsigned short cyls;          /* 1  默认柱面数 */
+    unsigned short reserved2;
+    unsigned short heads;         /* 3  默认磁头数 */
+    unsigned short track_bytes;
+    unsigned short sector_bytes;
+    unsigned short sectors;       /* 6  默认每磁道扇区数 */
+    unsigned short vendor0[3];
+    unsigned char serial_no[20];  /* 10 序列号 */
+    unsigned short buf_type;
+    unsigned short buf_size;
+    unsigned short ecc_bytes;
+    unsigned char fw_rev[8];      /* 23 固件版本 */
+    unsigned char model[40];      /* 27 型号 */
+    unsigned char max_multsect;   /* 47 多扇区读写每组最多扇区数, 0为不支持 */
+    unsigned char vendor3;
+    unsigned short dword_io;
+    unsigned char vendor4;
+    unsigned char capability;     /* 49 bit0-支持DMA, bit1-支持LBA */
+    unsigned short reserved50;
+    unsigned short tPIO;
+    unsigned short tDMA;
+    unsigned short field_valid;   /* 53 */
+    unsigned short cur_cyls;
+    unsigned short cur_heads;
+    unsigned short cur_sectors;
+    unsigned short cur_capacity0;
+    unsigned short cur_capacity1;
+    unsigned char multsect;       /* 59 当前每组扇区数 */
+    unsigned char multsect_valid;
+    unsigned int lba_capacity;    /* 60 LBA28可寻址扇区总数 */
+    unsigned short dma_1word;
+    unsigned short dma_mword;     /* 63 支持/选中的多字DMA模式 */
+    unsigned short words64_82[19];
+    unsigned short command_set_2; /* 83 bit10-支持LBA48 */
+    unsigned short words84_87[4];
+    unsigned short dma_ultra;     /* 88 支持/选中的Ultra DMA模式 */
+    unsigned short words89_99[11];
+    unsigned int lba_capacity_2[2]; /* 100 LBA48可寻址扇区总数(低, 高32位) */
+    unsigned short words104_255[152];
+};
+
 #endif
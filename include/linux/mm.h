@@ -3,6 +3,14 @@
 
 #define PAGE_SIZE 4096
 
+/* LOW_MEM - 实模式内存大小。
+ * MAP_NR(addr) - 计算addr在扩展内存中的页偏移。*/
+#define LOW_MEM 0x100000
+#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
+
+/* 扩展内存各页的引用计数, 见mm/memory.c */
+extern unsigned char mem_map[];
+
 extern unsigned long get_free_page(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
@@ -1,8 +1,36 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
+/* 任务号为nr的进程占用线性地址空间[nr*TASK_SIZE, (nr+1)*TASK_SIZE),
+ * 4Gb线性地址空间最多容纳NR_TASKS个进程。任务0与内核共用最低的16Mb
+ * (见head.s), 所以TASK_SIZE不能小于16Mb, 即NR_TASKS不能大于256。
+ * NR_TASKS为64时每个进程有64Mb, 为256时有16Mb。*/
+#define NR_TASKS 256
+#if NR_TASKS > 256 || (NR_TASKS & (NR_TASKS - 1))
+#error "NR_TASKS must be a power of two not above 256"
+#endif
+#define TASK_SIZE (0x40000000/NR_TASKS*4)
+
+/* HZ为每秒的时钟滴答数, 可修改此处或在编译所有目录时都以-DHZ=1000这样
+ * 的选项指定。HZ越大进程调度和定时器的粒度越细, 但时钟中断的开销越大。
+ * LATCH须在定时器0的16位计数范围内, 且以微秒计的时刻(见sched_clock)不能
+ * 溢出, 故HZ在100到1000之间。*/
+#ifndef HZ
 #define HZ 100
+#endif
+#if HZ < 100 || HZ > 1000
+#error "HZ must be between 100 and 1000"
+#endif
+/* 1193180Hz为定时器工作频率, LATCH为每个时钟滴答的定时器计数值 */
+#define LATCH (1193180/HZ)
+
+/* 进程的默认优先级(时间片数), 即150ms */
+#define DEF_PRIORITY (15*HZ/100)
+
+/* TICKS_TO_CLOCKS,
+ * 将滴答数t换算为用户程序所用的时钟数(每秒CLOCKS_PER_SEC即100个),
+ * 先除后乘以免溢出。*/
+#define TICKS_TO_CLOCKS(t) ((t)/HZ*100 + (t)%HZ*100/HZ)
 
 #define FIRST_TASK task[0]
 #define LAST_TASK task[NR_TASKS-1]
@@ -10,7 +38,9 @@
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/timer.h>
 #include <signal.h>
+#include <sched.h>
 
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
@@ -98,7 +128,7 @@ struct tss_struct {
 struct task_struct {
 /* these are hardcoded - don't touch */
 /* state,标识进程当前运行状态,-1,不可运行未就绪状态,0,可运行状态,>0已停止;
- * counter,进程运行时间片数(1时间片指定时器中断发生周期,此处1时间片约为10ms);
+ * counter,进程运行时间片数(1时间片指定时器中断发生周期,即1/HZ秒);
  * priority,标识进程优先级;
  * signal,记录进程当前被施加的信号,每bit对应一种信号;
  * sigaction,处理signal所记录信号的回调函数,可由用户程序设置;
@@ -153,6 +183,46 @@ struct task_struct {
     struct desc_struct ldt[3];
 /* tss for this task */
     struct tss_struct tss;
+/* run queue */
+    /* nr,任务号即在task[]中的下标;
+     * epoch,时间片最近一次被重新计算时的调度轮次(见enqueue_task);
+     * run_next,run_prev,在运行队列中同一优先级链表的前后进程,
+     * 不在运行队列中时run_next为NULL。*/
+    int nr;
+    long epoch;
+    struct task_struct *run_next, *run_prev;
+/* kesp,进程被切换出去时的内核栈指针(见switch_to) */
+    long kesp;
+/* alarm_timer,报警定时器, 到期时刻为alarm(见sys_alarm) */
+    struct timer_list alarm_timer;
+/* task lists */
+    /* next_task,prev_task,所有进程的循环链表(以任务0为表头);
+     * pidhash_*,pgrp_*,session_*,按进程id,进程组id,会话id散列的
+     * 链表, *_pprev指向前一进程中的*_next(或表头), 可常数时间移除;
+     * p_pptr,父进程; p_cptr,最年轻的子进程; p_ysptr,p_osptr,
+     * 同一父进程中比本进程年轻和年长的兄弟进程。*/
+    struct task_struct *next_task, *prev_task;
+    struct task_struct *pidhash_next, **pidhash_pprev;
+    struct task_struct *pgrp_next, **pgrp_pprev;
+    struct task_struct *session_next, **session_pprev;
+    struct task_struct *p_pptr, *p_cptr, *p_ysptr, *p_osptr;
+/* sched stats */
+    /* run_delay,可运行但在运行队列中等待的总时间(滴答数);
+     * pcount,被调度运行的次数;
+     * nvcsw,nivcsw,主动(睡眠,退出)和被动(时间片用完)让出CPU的次数;
+     * last_run,最近一次被调度运行的时刻(jiffies);
+     * last_queued,最近一次进入运行队列的时刻(jiffies);
+     * last_woken,最近一次被唤醒的时刻(微秒, 见sched_clock);
+     * woken,最近一次是被唤醒(而非被切换出去时仍可运行)而进入运行队列。*/
+    unsigned long run_delay, pcount, nvcsw, nivcsw, last_run, last_queued;
+    unsigned long last_woken;
+    int woken;
+/* scheduling policy */
+    /* policy,调度策略(见<sched.h>); rt_priority,实时进程的静态优先级;
+     * run_array,所在的运行队列, 不在运行队列中时无意义。*/
+    int policy;
+    int rt_priority;
+    struct prio_array * run_array;
 };
 
 /*
@@ -162,7 +232,7 @@ struct task_struct {
 /* INIT_TASK,
  * 用于初始化管理初始任务结构体。见 init_task 的初始化 */
 #define INIT_TASK \
-/* state etc */ { 0,15,15, \
+/* state etc */ { 0,DEF_PRIORITY,DEF_PRIORITY, \
 /* signals */   0,{{},},0, \
 /* ec,brk... */ 0,0,0,0,0,0, \
 /* pid etc.. */ 0,-1,0,0,0, \
@@ -182,6 +252,14 @@ struct task_struct {
     _LDT(0),0x80000000, \
         {} \
     }, \
+/* run queue */ 0,0,NULL,NULL, \
+/* kesp */  0, \
+/* alarm timer */ {NULL,NULL,0,0,NULL}, \
+/* task lists */ &init_task.task,&init_task.task, \
+    NULL,NULL,NULL,NULL,NULL,NULL, \
+    &init_task.task,NULL,NULL,NULL, \
+/* sched stats */ 0,0,0,0,0,0,0,0, \
+/* policy */    SCHED_OTHER,0,NULL, \
 }
 
 extern struct task_struct *task[NR_TASKS];
@@ -189,56 +267,58 @@ extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
 extern long volatile jiffies;
 extern long startup_time;
+extern long sched_epoch;
+extern void set_alarm(long expires);
 
 /* CURRENT_TIME,
  * 自1970年1月1号0时0分0秒到此时的秒数。*/
 #define CURRENT_TIME (startup_time+jiffies/HZ)
 
-extern void add_timer(long jiffies, void (*fn)(void));
-extern void sleep_on(struct task_struct ** p);
-extern void interruptible_sleep_on(struct task_struct ** p);
-extern void wake_up(struct task_struct ** p);
+/* 实时进程的静态优先级为1到MAX_RT_PRIO-1 */
+#define MAX_RT_PRIO 100
+#define rt_task(p) ((p)->policy != SCHED_OTHER)
+
+extern int need_resched;
+extern void wake_up_process(struct task_struct * p);
+extern void post_sig(struct task_struct * p, long sig);
+extern unsigned long sched_clock(void);
+
+/* 进程id, 进程组id和会话id的散列表(见kernel/fork.c) */
+#define PIDHASH_SZ (NR_TASKS >> 2)
+#define pid_hashfn(x) ((((x) >> 8) ^ (x)) & (PIDHASH_SZ - 1))
+
+extern struct task_struct * pidhash[PIDHASH_SZ];
+extern struct task_struct * pgrphash[PIDHASH_SZ];
+extern struct task_struct * sessionhash[PIDHASH_SZ];
+
+extern struct task_struct * find_task_by_pid(long pid);
+extern void set_pgrp(struct task_struct * p, long pgrp);
+extern void set_session(struct task_struct * p, long session);
+extern void unlink_task(struct task_struct * p);
+extern void reparent_children(struct task_struct * p);
+
+/* for_each_task,
+ * 遍历除任务0外的所有进程。*/
+#define for_each_task(p) \
+    for (p = task[0] ; (p = p->next_task) != task[0] ; )
 
 /*
- * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
- * 4-TSS0, 5-LDT0, 6-TSS1, 7-LDT1 etc ...
+ * Entry into gdt where to find the TSS and the first LDT. 0-nul, 1-cs,
+ * 2-ds, 3-syscall, 4-TSS (shared by all tasks), 5-LDT0, 6-LDT1 etc ...
  */
 #define FIRST_TSS_ENTRY 4
 #define FIRST_LDT_ENTRY (FIRST_TSS_ENTRY+1)
 
-/* _TSS(n)计算任务n TSS在GDT中的选择符,
+/* _TSS计算所有进程共用的TSS在GDT中的选择符,
  * _LDT(n)计算任务n LDT在GDT中的选择符。*/
-#define _TSS(n) ((((unsigned long) n)<<4)+(FIRST_TSS_ENTRY<<3))
-#define _LDT(n) ((((unsigned long) n)<<4)+(FIRST_LDT_ENTRY<<3))
+#define _TSS (FIRST_TSS_ENTRY<<3)
+#define _LDT(n) ((((unsigned long) n)<<3)+(FIRST_LDT_ENTRY<<3))
 
-/* ltr(n),  将任务n TSS的GDT选择符加载给TR寄存器,
+/* ltr(),   将TSS的GDT选择符加载给TR寄存器,
  * lldt(n), 将任务n LDT的GDT选择符加载给LDTR寄存器。*/
-#define ltr(n) __asm__("ltr %%ax"::"a" (_TSS(n)))
+#define ltr() __asm__("ltr %%ax"::"a" (_TSS))
 #define lldt(n) __asm__("lldt %%ax"::"a" (_LDT(n)))
 
-/* str(n),
- * 获取当前任务TSS在GDT中的编号, 并赋值给变量n。
- * 
- * 内联汇编输入部分。
- * "a" (0), 将0赋给eax;
- * "i" (FIRST_TSS_ENTRY<<3), 立即数FIRST_TSS_ENTRY<<3,
- * 立即数一般会被编译器保存在某通用空闲寄存器中,
- * FIRST_TSS_ENTRY是第一个TSS在GDT中的索引。
- *
- * 内联汇编指令。
- * str %%ax, 将任务寄存器TR的值赋给ax;
- * subl %2,%%eax, eax=eax - (FIRST_TSS_ENTRY<<3)。
- * shrl $4, %%eax, eax >> 4(算术右移4位), 即得到当前TSS在GDT中编号,
- * TSS在GDT中编号的算法跟其在GDT中设置, 见_TSS(n)宏。
- *
- * 内联汇编输出。
- * n = eax。*/
-#define str(n) \
-__asm__("str %%ax\n\t" \
-	"subl %2,%%eax\n\t" \
-	"shrl $4,%%eax" \
-	:"=a" (n) \
-	:"a" (0),"i" (FIRST_TSS_ENTRY<<3))
 /*
  *  switch_to(n) should switch tasks to task nr n, first
  * checking that n isn't the current task, in which case it does nothing.
@@ -248,44 +328,51 @@ __asm__("str %%ax\n\t" \
 /* switch_to,
  * 切换到任务号为n的进程中运行。
  *
- * 内联汇编输入部分。
- * "d" (_TSS(n)), edx = _TSS(n)即欲切换进程的TSS选择符;
- * "c" ((long) task[n])),ecx = (long) task[n]即管理欲切换进程的结构体地址;
- * "m" (*&__tmp.a), 内存变量__tmp.a;
- * "m" (*&__tmp.b), 内存变量__tmp.b。
- *
- * 内联汇编指令部分。
- * cmpl %%ecx,_current; je 1f
- * 比较欲切换进程是否为当前运行进程,若是则向前跳转到标号1处结束进程切换;
- * 
- * movw %%dx,%1; xchgl %%ecx,_current
- * 若欲切换进程非当前进程,则将dx(TSS选择符)赋给%1即__tmp.b,然后将当前进
- * 程结构体指针current指向欲切换进程结构体;
+ * 进程切换不再用ljmp经TSS描述符由CPU完成(CPU硬件任务切换要保存和
+ * 加载整个TSS并检查各段描述符, 比软件只保存几个寄存器慢得多)。
+ * 所有进程共用任务0的TSS(sched_init中已加载到TR), 其中只有ss0:esp0
+ * 有用, 即用户态进入内核时所用的内核栈, 切换时改为下一进程的内核
+ * 栈顶。各进程的LDT不同所以每次切换都重新加载LDTR; 页目录(cr3)只在
+ * 不同时才重新加载(目前所有进程共用pg_dir)。硬件任务切换会置CR0的
+ * TS位, 此处按原来的约定: 下一进程最近用过协处理器则清TS, 否则置TS
+ * 以便其使用协处理器时由math_state_restore换入其协处理器状态。
  *
- * ljmp %0
- * 随后通过长跳转指令ljmp实现任务切换,此处的ljmp指令将__tmp所在内存段内容
- * 作为操作数——低4字节为偏移地址, 接下来的2字节(__tmp.b低2字节)为段选择符。
- * 由于此处的段选择符将索引到描述TSS的GDT表项,这将会引起任务切换。这个过程
- * 大体如下:将本进程运行上下文备份到其TSS中; 将欲切换进程TSS选择符加载到TR
- * 寄存器中并从该TSS种获取欲切换进程运行上下文(CS:EIP SS:ESP LDT选择符等)。
- * (所以没在__tmp.a中指定偏移地址是没有关系的)。
+ * 内联汇编将ebp, fs, gs和返回地址(标号1)压入本进程内核栈, 将esp
+ * 保存到current->kesp, 再换到下一进程的内核栈并由ret"返回"到其上次
+ * 被切换出去处的标号1(新进程为ret_from_fork, 见fork.c)。eax, ebx,
+ * ecx, edx, esi, edi由gcc在调用处自行保存; fs和gs须在加载LDTR后重新
+ * 加载, 以让段描述符缓存取自下一进程的LDT。
  *
- * cmpl %%ecx,_last_task_used_math; jne 1f; clts
- * 这条语句在本进程再次本调度时执行,该语句 ======= 上次是否使用过协处理器。
- * 若没有则向前跳转标号1处,若使用过则清协处理器使用标志(CR0 TS位)。*/
+ * 须在关中断下调用(见schedule)。*/
 #define switch_to(n) {\
-struct {long a,b;} __tmp; \
-__asm__("cmpl %%ecx,_current\n\t" \
-    "je 1f\n\t" \
-    "movw %%dx,%1\n\t" \
-    "xchgl %%ecx,_current\n\t" \
-    "ljmp %0\n\t" \
-    "cmpl %%ecx,_last_task_used_math\n\t" \
-    "jne 1f\n\t" \
-    "clts\n" \
-    "1:" \
-    ::"m" (*&__tmp.a),"m" (*&__tmp.b), \
-    "d" (_TSS(n)),"c" ((long) task[n])); \
+struct task_struct * __next = task[n]; \
+long __d0, __d1, __d2; \
+if (__next != current) { \
+    task[0]->tss.esp0 = PAGE_SIZE + (long) __next; \
+    lldt(n); \
+    if (__next->tss.cr3 != current->tss.cr3) \
+        __asm__("movl %0,%%cr3"::"r" (__next->tss.cr3)); \
+    if (__next == last_task_used_math) \
+        __asm__("clts"); \
+    else \
+        __asm__("movl %%cr0,%%eax\n\t" \
+            "orl $8,%%eax\n\t" \
+            "movl %%eax,%%cr0":::"ax"); \
+    __asm__ __volatile__("pushl %%ebp\n\t" \
+        "push %%fs\n\t" \
+        "push %%gs\n\t" \
+        "pushl $1f\n\t" \
+        "movl %%esp,(%%eax)\n\t" \
+        "movl %%ecx,%%esp\n\t" \
+        "movl %%edx,_current\n\t" \
+        "ret\n" \
+        "1:\tpop %%gs\n\t" \
+        "pop %%fs\n\t" \
+        "popl %%ebp" \
+        :"=a" (__d0),"=c" (__d1),"=d" (__d2) \
+        :"0" (&current->kesp),"1" (__next->kesp),"2" (__next) \
+        :"bx","si","di","memory"); \
+} \
 }
 
 #define PAGE_ALIGN(n) (((n)+0xfff)&0xfffff000)
@@ -70,6 +70,17 @@ extern int sys_sgetmask();
 extern int sys_ssetmask();
 extern int sys_setreuid();
 extern int sys_setregid();
+extern int sys_bdflush();
+extern int sys_iostat();
+extern int sys_schedstat();
+extern int sys_sched_setscheduler();
+extern int sys_sched_getscheduler();
+extern int sys_sched_setparam();
+extern int sys_sched_getparam();
+extern int sys_sched_get_priority_max();
+extern int sys_sched_get_priority_min();
+extern int sys_sched_yield();
+extern int sys_iosched();
 
 /* 系统调用子程序静态数组,该数组中包含了各个系统调用的在内核段中的偏移
  * 地址,sys_call_table[2]为系统调用sys_fork在内核代码段中的偏移地址,该
@@ -86,4 +97,7 @@ sys_getgid, sys_signal, sys_geteuid, sys_getegid, sys_acct, sys_phys,
 sys_lock, sys_ioctl, sys_fcntl, sys_mpx, sys_setpgid, sys_ulimit,
 sys_uname, sys_umask, sys_chroot, sys_ustat, sys_dup2, sys_getppid,
 sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
-sys_setreuid,sys_setregid };
+sys_setreuid,sys_setregid, sys_bdflush, sys_iostat, sys_schedstat,
+sys_sched_setscheduler, sys_sched_getscheduler, sys_sched_setparam,
+sys_sched_getparam, sys_sched_get_priority_max, sys_sched_get_priority_min,
+sys_sched_yield, sys_iosched };
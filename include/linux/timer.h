@@ -0,0 +1,27 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/* 内核定时器(见kernel/sched.c中的分级时间轮)。
+ *
+ * 定时器结构体由使用者提供(静态变量或嵌在其他结构体中), 不占用
+ * 固定大小的定时器池。在jiffies到达expires的那次定时器中断中以
+ * data为参数调用function, 调用前定时器已被移出时间轮, 回调函数中
+ * 可再次加入。加入和删除都是常数时间。
+ *
+ * next,prev须在第一次使用前置为NULL(init_timer), 定时器在时间轮
+ * 中时next或prev不为NULL(见timer_pending)。*/
+struct timer_list {
+    struct timer_list * next, * prev;
+    unsigned long expires;
+    unsigned long data;
+    void (*function)(unsigned long);
+};
+
+#define init_timer(timer) ((timer)->next = (timer)->prev = NULL)
+#define timer_pending(timer) ((timer)->prev != NULL)
+
+extern void add_timer(struct timer_list * timer);
+extern int del_timer(struct timer_list * timer);
+extern void mod_timer(struct timer_list * timer, unsigned long expires);
+
+#endif
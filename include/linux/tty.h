@@ -14,6 +14,7 @@
 #define _TTY_H
 
 #include <termios.h>
+#include <linux/wait.h>
 
 #define TTY_BUF_SIZE 1024
 /* struct tty_queue,
@@ -22,7 +23,7 @@ struct tty_queue {
     unsigned long data; /* 存串口控制器的起始端口地址;计数队列所含行数 */
     unsigned long head; /* buf头部数据的索引 */
     unsigned long tail; /* buf尾部数据的索引 */
-    struct task_struct * proc_list; /* 用于同步其他进程对本队列的访问 */
+    struct wait_queue * proc_list; /* 用于同步其他进程对本队列的访问 */
     char buf[TTY_BUF_SIZE]; /* 用于缓存数据 */
 };
 
@@ -0,0 +1,29 @@
+#ifndef _WAIT_H
+#define _WAIT_H
+
+/* 等待队列(见kernel/sched.c中的sleep_on和wake_up)。
+ *
+ * 等待队列以指向struct wait_queue的指针表示, 为NULL时队列为空。
+ * 每个睡眠的进程在其内核栈上有一个队列元素, 按睡眠先后链入循环
+ * 双向链表(先进先出), 被唤醒并再次运行后自行从队列中移除。
+ *
+ * wake_up唤醒队列中所有非独占等待的进程, 和按顺序第一个尚在睡眠
+ * 的独占等待的进程; wake_up_all唤醒所有进程。独占等待用于只有一个
+ * 进程能得到所等资源的场合(如空闲缓冲区块, 空闲请求项, 锁), 以免
+ * 一次释放唤醒所有等待者而其中大多数又马上睡眠。*/
+
+#define WQ_EXCLUSIVE 1
+
+struct wait_queue {
+    struct task_struct * task;
+    int flags;
+    struct wait_queue * next, * prev;
+};
+
+extern void sleep_on(struct wait_queue ** q);
+extern void sleep_on_exclusive(struct wait_queue ** q);
+extern void interruptible_sleep_on(struct wait_queue ** q);
+extern void wake_up(struct wait_queue ** q);
+extern void wake_up_all(struct wait_queue ** q);
+
+#endif
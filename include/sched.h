@@ -0,0 +1,32 @@
+#ifndef _SCHED_PARAM_H
+#define _SCHED_PARAM_H
+
+#include <sys/types.h>
+
+/* 调度策略。
+ * SCHED_OTHER, 普通进程, 按时间片分时运行, 时间片长短由nice调整;
+ * SCHED_FIFO,  实时进程, 一直运行到阻塞, 让出CPU或被更高优先级的
+ *              实时进程抢占, 没有时间片;
+ * SCHED_RR,    实时进程, 同SCHED_FIFO, 但同一优先级的进程按时间片
+ *              轮流运行。
+ * 实时进程的静态优先级为1(最低)到99(最高), 可运行的实时进程总是先于
+ * 普通进程运行; 普通进程的静态优先级为0。只有超级用户可以设置实时
+ * 调度策略。*/
+#define SCHED_OTHER 0
+#define SCHED_FIFO  1
+#define SCHED_RR    2
+
+struct sched_param {
+    int sched_priority;
+};
+
+extern int sched_setscheduler(pid_t pid, int policy,
+    const struct sched_param * param);
+extern int sched_getscheduler(pid_t pid);
+extern int sched_setparam(pid_t pid, const struct sched_param * param);
+extern int sched_getparam(pid_t pid, struct sched_param * param);
+extern int sched_get_priority_max(int policy);
+extern int sched_get_priority_min(int policy);
+extern int sched_yield(void);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _SYS_IOSTAT_H
+#define _SYS_IOSTAT_H
+
+#include <sys/types.h>
+
+/* 延迟直方图的桶数。第i个桶统计延迟在[2^i, 2^(i+1))微秒内的请求数,
+ * 第0个桶还包括不足1微秒的请求。*/
+#define IOSTAT_BUCKETS 32
+
+/* struct iostat,
+ * 一个块设备(主、次设备号)上已完成请求的统计信息。
+ * wait为请求从入队到开始处理(排队)的时间, service为从开始
+ * 处理到完成的时间。
+ *
+ * nr_requests起为该设备所属块设备(主设备号)请求项池的当前状态,
+ * 同一块设备上的各设备共用一个请求项池。*/
+struct iostat {
+    dev_t dev;
+    unsigned long reads;   /* 已完成的读请求数 */
+    unsigned long writes;  /* 已完成的写请求数 */
+    unsigned long wait[IOSTAT_BUCKETS];
+    unsigned long service[IOSTAT_BUCKETS];
+    int nr_requests;       /* 请求项池大小 */
+    int nr_free;           /* 空闲请求项数 */
+    int nr_writes;         /* 在用的写请求项数 */
+    unsigned long congested; /* 进程因无可用请求项而等待的次数 */
+};
+
+/* 读取第index个块设备的统计信息, index超出已有设备数时返回-1(EINVAL) */
+extern int iostat(int index, struct iostat * buf);
+
+/* 块设备请求调度器编号, 用于iosched */
+#define IOSCHED_ELEVATOR 0  /* 原电梯算法 */
+#define IOSCHED_CSCAN    1  /* C-SCAN */
+#define IOSCHED_DEADLINE 2  /* deadline */
+
+/* 将主设备号为major的块设备的请求调度器换为sched, 返回原调度器编号;
+ * sched为负时只返回当前调度器编号。更换须超级用户, 且设备请求队列为空,
+ * 否则返回-1(EPERM或EBUSY)。*/
+extern int iosched(int major, int sched);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _SYS_SCHEDSTAT_H
+#define _SYS_SCHEDSTAT_H
+
+#include <sys/types.h>
+
+/* 唤醒延迟直方图的桶数。第i个桶统计从被唤醒到被调度运行的时间在
+ * [2^i, 2^(i+1))微秒内的次数, 第0个桶还包括不足1微秒的。*/
+#define SCHEDSTAT_BUCKETS 32
+
+/* struct schedstat,
+ * 一个进程的调度统计信息, 以及全系统的唤醒延迟直方图。
+ * utime,stime,last_run以时钟数(CLOCKS_PER_SEC)计, 与times相同;
+ * run_delay以微秒计(精度为一个时钟滴答), 约71分钟回绕一次。*/
+struct schedstat {
+    pid_t pid;
+    unsigned long utime;     /* 用户态运行时间 */
+    unsigned long stime;     /* 内核态运行时间 */
+    unsigned long run_delay; /* 可运行但在等待CPU的总时间 */
+    unsigned long pcount;    /* 被调度运行的次数 */
+    unsigned long nvcsw;     /* 主动让出CPU(睡眠, 退出)的次数 */
+    unsigned long nivcsw;    /* 被动让出CPU(时间片用完)的次数 */
+    unsigned long last_run;  /* 最近一次被调度运行时times的返回值 */
+    unsigned long latency[SCHEDSTAT_BUCKETS];
+};
+
+/* 读取进程id为pid(为0时为调用进程)的进程的调度统计, 进程不存在时
+ * 返回-1(ESRCH) */
+extern int schedstat(pid_t pid, struct schedstat * buf);
+
+#endif
@@ -56,6 +56,8 @@
 #include <sys/stat.h>
 #include <sys/times.h>
 #include <sys/utsname.h>
+#include <sys/iostat.h>
+#include <sys/schedstat.h>
 #include <utime.h>
 
 #ifdef __LIBRARY__
@@ -133,6 +135,17 @@
 #define __NR_ssetmask   69
 #define __NR_setreuid   70
 #define __NR_setregid   71
+#define __NR_bdflush    72
+#define __NR_iostat     73
+#define __NR_schedstat  74
+#define __NR_sched_setscheduler 75
+#define __NR_sched_getscheduler 76
+#define __NR_sched_setparam     77
+#define __NR_sched_getparam     78
+#define __NR_sched_get_priority_max 79
+#define __NR_sched_get_priority_min 80
+#define __NR_sched_yield        81
+#define __NR_iosched    82
 
 /* _syscall0(type,name),
  * 用于定义名为name返回值类型为type的无参类型系统调用。
@@ -279,6 +292,10 @@ int stat(const char * filename, struct stat * stat_buf);
 int fstat(int fildes, struct stat * stat_buf);
 int stime(time_t * tptr);
 int sync(void);
+int bdflush(void);
+int iostat(int index, struct iostat * buf);
+int iosched(int major, int sched);
+int schedstat(pid_t pid, struct schedstat * buf);
 time_t time(time_t * tloc);
 time_t times(struct tms * tbuf);
 int ulimit(int cmd, long limit);
@@ -31,6 +31,7 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall0(int,bdflush)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -50,7 +51,7 @@ static char printbuf[1024];
 
 extern int vsprintf();
 extern void init(void);
-extern void blk_dev_init(void);
+extern void blk_dev_init(long mem_size);
 extern void chr_dev_init(void);
 extern void hd_init(void);
 extern void floppy_init(void);
@@ -198,7 +199,7 @@ void main(void) /* This really IS void, no error here. */
     mem_init(main_memory_start,memory_end);
 
     trap_init();    /* 初始设置IDT和PIC */
-    blk_dev_init(); /* 块设备请求管理初始化 */
+    blk_dev_init(memory_end); /* 块设备请求管理初始化 */
     chr_dev_init();
     tty_init();     /* 字符设备及其请求管理的初始化 */
     time_init();    /* 设置系统开机时间 */
@@ -306,6 +307,14 @@ void init(void)
         NR_BUFFERS*BLOCK_SIZE);
     printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
 
+    /* 创建缓冲区回写守护进程。
+     * 系统调用bdflush(内核函数为fs/buffer.c/sys_bdflush)不会返回,
+     * 它在内核中周期性地或在脏缓冲区块过多时将脏缓冲区块写回设备。*/
+    if (!fork()) {
+        bdflush();
+        _exit(1);
+    }
+
     /* 在init进程中创建子进程 */
     if (!(pid=fork())) {
         /* 在init子进程中关闭标准输入。以用文件描述
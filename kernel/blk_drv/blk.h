@@ -1,6 +1,8 @@
 #ifndef _BLK_H
 #define _BLK_H
 
+#include <linux/blktrace.h>
+
 #define NR_BLK_DEV 7
 /*
  * NR_REQUEST is the number of entries in the request-queue.
@@ -20,6 +22,13 @@
  * 求的暂停感。*/
 #define NR_REQUEST 32
 
+/* 以上为硬盘请求项池的基本大小, 各块设备的请求项池在blk_dev_init中
+ * 按内存大小分配(见ll_rw_blk.c), 各设备互不占用对方的请求项。*/
+
+/* 一个(合并后的)请求最多可包含的扇区数。
+ * 硬盘控制器的扇区数寄存器为8位, 此处取128即64个缓冲区块。*/
+#define MAX_SECTORS 128
+
 /*
  * Ok, this is an expanded form so that we can use the same
  * request for paging requests when that is implemented. In
@@ -28,17 +37,28 @@
  */
 /* 注,为了在实现页请求功能后也能用该结构体进行页请求,此文对该
  * 结构体类型做了扩展。当用于页请求时, 成员 bh 赋值为NULL, 成
- * 员 waiting 用于等待读/写操作完成。*/
+ * 员 waiting 用于等待读/写操作完成。
+ *
+ * 设备上相邻逻辑块的请求会被合并为一个请求, 各缓冲区块经b_reqnext
+ * 串成链表, bh指向当前正在传输的缓冲区块, buffer指向其中的当前位置;
+ * 每传输完一个缓冲区块, end_request就让bh和buffer指向下一个缓冲区块,
+ * 直到链表中的缓冲区块都传输完才结束整个请求。*/
 struct request {
     int dev; /* -1 if no request */
     int cmd; /* READ or WRITE */
     int errors;
     unsigned long sector;     /* 当前设备分区中的当前扇区号 */
-    unsigned long nr_sectors; /* 欲读/写扇区数 */
+    unsigned long nr_sectors; /* 剩余欲读/写扇区数 */
     char * buffer; /* 用于缓存访问设备数据的内存段 */
-    struct task_struct * waiting; /* 用于进程等待当前请求元素 */
-    struct buffer_head * bh; /* 管理缓冲区块的节点 */
+    struct wait_queue * waiting; /* 用于进程等待当前请求元素 */
+    struct buffer_head * bh;     /* 管理当前缓冲区块的节点 */
+    struct buffer_head * bhtail; /* 请求中最后一个缓冲区块, 用于向后合并 */
     struct request * next;   /* 同一设备上的下一个请求 */
+    unsigned long expires;   /* deadline调度器: 请求到期的时刻(jiffies) */
+    struct request * fifo_next; /* deadline调度器: 同方向请求的FIFO */
+    struct request * fifo_prev;
+    unsigned long start_time;    /* 请求入队的时刻(微秒, 见blk_clock) */
+    unsigned long dispatch_time; /* 请求到达队列头部开始处理的时刻 */
 };
 
 /*
@@ -78,16 +98,46 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector)))
 
+struct blk_dev_struct;
+
+/* struct blk_sched,
+ * 块设备请求调度器, 决定设备请求队列中各请求的处理顺序。
+ * 队列头部(current_request)的请求正在被驱动程序处理, 不可移动。
+ *
+ * add - 将请求req加入设备dev的请求队列, 调用者已禁止中断。
+ * dispatch - 在队列头部请求结束时由end_request(在中断中)调用,
+ *     可调整队列使接下来应处理的请求紧跟在队列头部之后。可为NULL。*/
+struct blk_sched {
+    char * name;
+    void (*add)(struct blk_dev_struct * dev, struct request * req);
+    void (*dispatch)(struct blk_dev_struct * dev);
+};
+
+/* 见iostat.c */
+extern unsigned long blk_clock(void);
+extern unsigned long iostat_done(struct request * req);
+
+/* 见iosched.c */
+extern struct blk_sched elevator_sched;
+extern struct blk_sched cscan_sched;
+extern struct blk_sched deadline_sched;
+
 /* struct blk_dev_struct,
  * 块设备当前(读写)请求结构体类型。*/
 struct blk_dev_struct {
     void (*request_fn)(void); /* 指向块设备当前(读写)请求函数 */
     struct request * current_request; /* 块设备当前(读写)请求 */
+    struct blk_sched * sched; /* 块设备所用的请求调度器 */
+    struct request * fifo[2]; /* deadline调度器: 读和写请求的FIFO */
+    struct request * free_request; /* 空闲请求项链表(经next链接) */
+    struct wait_queue * wait_for_request; /* 等待空闲请求项的进程 */
+    int nr_requests;  /* 请求项池大小 */
+    int nr_free;      /* 空闲请求项数 */
+    int nr_writes;    /* 在用的写请求项数, 不超过池的2/3 */
+    unsigned long nr_congested; /* 进程因无可用请求项而等待的次数 */
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
-extern struct request request[NR_REQUEST];
-extern struct task_struct * wait_for_request;
 
 #ifdef MAJOR_NR
 
@@ -147,35 +197,72 @@ extern inline void unlock_buffer(struct buffer_head * bh)
 }
 
 /* end_request,
- * 结束块设备当前请求,调用当前请求的下一个请求。
+ * 结束块设备当前请求中的当前缓冲区块, 若请求中还有缓冲区块则
+ * 让请求指向下一个缓冲区块后返回, 否则结束当前请求,调用当前
+ * 请求的下一个请求。
  * 
  * uptodate=0,块设备请求失败;
  * uptodate=1,块设备请求成功。
+ *
+ * 成功时驱动程序须已将sector和nr_sectors推进到下一个缓冲区块处;
+ * 失败时由本函数跳过当前缓冲区块剩余的扇区。
  * 
  * 结束块设备当前请求时,会复位缓冲区块锁状态,
  * 会置位缓冲区块读数据的状态;会唤醒等在当前请
  * 求请求元素的进程;会唤醒在等空闲请求元素的进程。*/
 extern inline void end_request(int uptodate)
 {
-    /* 置缓冲区块数据是否已读标志,复位缓冲区块锁状态 */
-    DEVICE_OFF(CURRENT->dev);
-    if (CURRENT->bh) {
-        CURRENT->bh->b_uptodate = uptodate;
-        unlock_buffer(CURRENT->bh);
-    }
-    /* uptodate=0时,表示请求设备失败则提示 */
+    struct buffer_head * bh;
+    struct request * req;
+    unsigned long next, now;
+
+    /* uptodate=0时,表示请求设备失败则提示,
+     * 并将请求推进到下一个缓冲区块(2扇区)边界处。*/
     if (!uptodate) {
         printk(DEVICE_NAME " I/O error\n\r");
         printk("dev %04x, block %d\n\r",CURRENT->dev,
             CURRENT->bh->b_blocknr);
+        next = (CURRENT->sector | 1) + 1;
+        if (CURRENT->nr_sectors > next - CURRENT->sector)
+            CURRENT->nr_sectors -= next - CURRENT->sector;
+        else
+            CURRENT->nr_sectors = 0;
+        CURRENT->sector = next;
     }
+    /* 置缓冲区块数据是否已读标志,复位缓冲区块锁状态;
+     * 若请求中还有缓冲区块则继续传输下一个缓冲区块。*/
+    if (bh = CURRENT->bh) {
+        blk_trace(BT_COMPLETE,CURRENT->dev,CURRENT->cmd,
+            bh->b_blocknr<<1,2);
+        CURRENT->bh = bh->b_reqnext;
+        bh->b_reqnext = NULL;
+        bh->b_uptodate = uptodate;
+        unlock_buffer(bh);
+        if (bh = CURRENT->bh) {
+            CURRENT->buffer = bh->b_data;
+            CURRENT->errors = 0;
+            return;
+        }
+    }
+    DEVICE_OFF(CURRENT->dev);
     /* 唤醒在等当前请求元素的进程;
-     * 唤醒在等待空闲请求元素的进程;
-     * 复位当前请求元素并调用下一个块设备请求。*/
+     * 复位当前请求元素, 由调度器选出下一个块设备请求;
+     * 将当前请求元素放回设备的空闲请求项链表,
+     * 唤醒在等待该设备空闲请求元素的进程。*/
     wake_up(&CURRENT->waiting);
-    wake_up(&wait_for_request);
+    now = iostat_done(CURRENT);
     CURRENT->dev = -1;
-    CURRENT = CURRENT->next;
+    if (blk_dev[MAJOR_NR].sched->dispatch)
+        blk_dev[MAJOR_NR].sched->dispatch(blk_dev + MAJOR_NR);
+    req = CURRENT;
+    if (CURRENT = req->next)
+        CURRENT->dispatch_time = now;
+    req->next = blk_dev[MAJOR_NR].free_request;
+    blk_dev[MAJOR_NR].free_request = req;
+    blk_dev[MAJOR_NR].nr_free++;
+    if (req->cmd == WRITE)
+        blk_dev[MAJOR_NR].nr_writes--;
+    wake_up(&blk_dev[MAJOR_NR].wait_for_request);
 }
 
 /* 检查当前请求是否为NULL,
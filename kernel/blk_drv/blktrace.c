@@ -0,0 +1,114 @@
+/*
+ *  linux/kernel/blk_drv/blktrace.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/* blktrace.c 块设备请求跟踪环形缓冲区。
+ *
+ * make_request, do_hd_request, end_request等在请求入队、合并、下发和
+ * 结束时调用blk_trace记录事件, 其中下发和结束发生在中断中。记录时
+ * 只在写入一个事件期间禁止中断, 不会睡眠, 也不会等待读者; 缓冲区
+ * 满时覆盖最早的事件并计数, 读者随后会先读到一个BT_LOST事件。
+ *
+ * 跟踪默认关闭。向字符设备(主设备号1, 次设备号5)写入非0字节开启,
+ * 写入0关闭并清空缓冲区, 末尾的空白和换行被忽略(如echo 0); 读该设备
+ * 取走已记录的完整事件, 没有事件时立即返回0。*/
+
+#include <errno.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/blktrace.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+
+#include "blk.h"
+
+/* 缓冲区可容纳的事件数, 须为2的幂 */
+#define BT_SIZE 512
+
+static struct blk_trace_event bt_ring[BT_SIZE];
+static unsigned long bt_head = 0; /* 下一个事件写入的位置(不取模) */
+static unsigned long bt_tail = 0; /* 下一个待读出事件的位置 */
+static unsigned long bt_lost = 0; /* 被覆盖而未读出的事件数 */
+static int bt_enabled = 0;
+
+/* blk_trace,
+ * 记录一个跟踪事件。可在中断中调用。*/
+void blk_trace(int action, int dev, int cmd,
+    unsigned long sector, int nr_sectors)
+{
+    struct blk_trace_event * ev;
+    unsigned long flags;
+
+    if (!bt_enabled)
+        return;
+    save_flags(flags);
+    cli();
+    ev = bt_ring + (bt_head++ & (BT_SIZE-1));
+    ev->time = blk_clock();
+    ev->sector = sector;
+    ev->dev = dev;
+    ev->action = action;
+    ev->cmd = cmd;
+    ev->nr_sectors = nr_sectors;
+    ev->pid = current->pid;
+    if (bt_head - bt_tail > BT_SIZE) {
+        bt_tail++;
+        bt_lost++;
+    }
+    restore_flags(flags);
+}
+
+/* rw_blktrace,
+ * 跟踪字符设备的读写函数。
+ * 读时最多取走count/sizeof(struct blk_trace_event)个事件到buf中,
+ * 返回读出的字节数; 写时以最后一个非空白字节开启或关闭跟踪, 全为
+ * 空白时不改变跟踪状态。*/
+int rw_blktrace(int rw, char * buf, int count)
+{
+    struct blk_trace_event ev;
+    int n = 0;
+    int i;
+    char c;
+
+    if (rw == WRITE) {
+        if (count <= 0)
+            return 0;
+        for (i = count - 1 ; i >= 0 ; i--) {
+            c = get_fs_byte(buf + i);
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                break;
+        }
+        if (i < 0)
+            return count;
+        cli();
+        if (!(bt_enabled = c != 0 && c != '0'))
+            bt_head = bt_tail = bt_lost = 0;
+        sti();
+        return count;
+    }
+    while (count - n >= sizeof(ev)) {
+        cli();
+        if (bt_lost) {
+            ev.time = blk_clock();
+            ev.sector = bt_lost;
+            ev.dev = 0;
+            ev.action = BT_LOST;
+            ev.cmd = 0;
+            ev.nr_sectors = 0;
+            ev.pid = 0;
+            bt_lost = 0;
+        } else if (bt_tail != bt_head)
+            ev = bt_ring[bt_tail++ & (BT_SIZE-1)];
+        else {
+            sti();
+            break;
+        }
+        sti();
+        memcpy_tofs(buf + n,&ev,sizeof(ev));
+        n += sizeof(ev);
+    }
+    return n;
+}
@@ -122,6 +122,7 @@ static struct floppy_struct {
 
 extern void floppy_interrupt(void);
 extern char tmp_floppy_area[1024];
+extern char floppy_track_buffer[512*2*18];
 
 /*
  * These are global variables, as that's the easiest way to give
@@ -139,8 +140,21 @@ static unsigned char track = 0;  /* 当前磁道号 */
 static unsigned char seek_track = 0; /* 寻道磁道号 */
 static unsigned char current_track = 255; /* 当前磁头所在磁道号 */
 static unsigned char command = 0; /* 当前访问软盘的操作命令 */
+
+/* 软驱请求定时器, 用于等待马达启动和选择软驱后再开始传输 */
+static struct timer_list fd_timer;
+
+/* 柱面缓存。读请求未命中时以DMA将整个柱面(各磁头全部扇区)读入
+ * floppy_track_buffer, 之后对该柱面的读请求直接从中拷贝, 顺序读
+ * 软盘时不必为每个缓冲区块等待一次磁盘旋转。写该柱面或更换软盘
+ * 时缓存作废。*/
+static int buffer_drive = -1; /* 缓存所属软驱号, -1表示缓存无效 */
+static struct floppy_struct * buffer_type = NULL; /* 缓存所属软盘类型 */
+static unsigned char buffer_track = 0; /* 缓存的磁道号 */
+static int read_track = 0; /* 当前DMA传输为读入整个柱面 */
+
 unsigned char selected = 0; /* 软驱是否已选择的标志 */
-struct task_struct * wait_on_floppy_select = NULL; /* 用于进程等待某软驱的任务指针 */
+struct wait_queue * wait_on_floppy_select = NULL; /* 用于进程等待某软驱的任务指针 */
 
 /* floppy_deselect,
  * 复位软驱已选择标志,唤醒等在当前软驱上的进程。*/
@@ -175,6 +189,8 @@ repeat:
 
     /* 读输入寄存器,bit[7]=1表示nr软驱下的软盘已更换 */
     if (inb(FD_DIR) & 0x80) {
+        if (buffer_drive == nr)
+            buffer_drive = -1;
         floppy_off(nr);
         return 1;
     }
@@ -209,12 +225,16 @@ static void setup_DMA(void)
 {
     /* 当前请求中用于存储数据的缓冲区首地址 */
     long addr = (long) CURRENT->buffer;
+    long count = BLOCK_SIZE;
 
 /* 因为DMA芯片8237A只能寻址1Mb以内内存地址空间,
  * 所以当addr地址超过1Mb时则使用软盘临时缓冲区
- * 承载访问软盘中的数据。*/
+ * 承载访问软盘中的数据。读入整个柱面时使用柱面缓存。*/
     cli();
-    if (addr >= 0x100000) {
+    if (read_track) {
+        addr = (long) floppy_track_buffer;
+        count = (floppy->sect * floppy->head) << 9;
+    } else if (addr >= 0x100000) {
     addr = (long) tmp_floppy_area;
     if (command == FD_WRITE)
         copy_buffer(CURRENT->buffer,tmp_floppy_area);
@@ -241,9 +261,9 @@ __asm__("outb %%al,$12\n\tjmp 1f\n1:\tjmp 1f\n1:\t"
     immoutb_p(addr,0x81);
 /* 向DMA端口地址0x05写入需传输的字节数 */
 /* low 8 bits of count-1 (1024-1=0x3ff) */
-    immoutb_p(0xff,5);
+    immoutb_p((count-1) & 0xff,5);
 /* high 8 bits of count-1 */
-    immoutb_p(3,5);
+    immoutb_p((count-1) >> 8,5);
 /* activate DMA 2 */
 /* 使能DMA通道2 */
     immoutb_p(0|2,10);
@@ -336,11 +356,25 @@ static void rw_interrupt(void)
         do_fd_request();
         return;
     }
+    /* 读入了整个柱面则记录缓存所属柱面, 由do_fd_request从缓存中
+     * 结束当前请求中该柱面上的各缓冲区块。*/
+    if (read_track) {
+        buffer_drive = current_drive;
+        buffer_type = floppy;
+        buffer_track = track;
+        floppy_deselect(current_drive);
+        do_fd_request();
+        return;
+    }
     /* 若当前读软盘且原缓冲区块在1Mb以外则拷贝软盘临时缓冲区块的数据到目的
      * 缓冲区块中并结束本次软盘请求,并继续调度下一个软盘请求。*/
     if (command == FD_READ && (unsigned long)(CURRENT->buffer) >= 0x100000)
         copy_buffer(tmp_floppy_area,CURRENT->buffer);
     floppy_deselect(current_drive);
+    /* 软盘每次只传输一个缓冲区块(2扇区), 推进请求后结束该缓冲区块,
+     * 若合并后的请求中还有缓冲区块, do_fd_request会继续传输下一块。*/
+    CURRENT->sector += 2;
+    CURRENT->nr_sectors -= 2;
     end_request(1);
     do_fd_request();
 }
@@ -514,6 +548,26 @@ static void reset_floppy(void)
     sti();
 }
 
+/* fd_timer_callback,
+ * 软驱请求定时器超时回调函数, 调用data所指函数。*/
+static void fd_timer_callback(unsigned long data)
+{
+    ((void (*)(void)) data)();
+}
+
+/* fd_delay,
+ * ticks个时间片后调用fn, ticks不大于0时立即调用。*/
+static void fd_delay(long ticks, void (*fn)(void))
+{
+    if (ticks <= 0) {
+        fn();
+        return;
+    }
+    fd_timer.data = (unsigned long) fn;
+    fd_timer.function = fd_timer_callback;
+    mod_timer(&fd_timer,jiffies+ticks);
+}
+
 /* floppy_on_interrupt,
  * 软盘定时超时回调函数。*/
 static void floppy_on_interrupt(void)
@@ -524,7 +578,7 @@ static void floppy_on_interrupt(void)
         current_DOR &= 0xFC;
         current_DOR |= current_drive;
         outb(current_DOR,FD_DOR);
-        add_timer(2,&transfer);
+        fd_delay(HZ/50,&transfer);
     } else
         transfer();
 }
@@ -571,16 +625,36 @@ void do_fd_request(void)
     if (seek_track != current_track)
         seek = 1; /* 若当前磁道和欲访问磁道不同则置寻道标志 */
     sector++;
-    if (CURRENT->cmd == READ)
+    if (CURRENT->cmd == READ) {
+        /* 柱面已在缓存中则直接拷贝, 未命中则读入整个柱面;
+         * 读出错重试时只读当前缓冲区块, 以免受柱面中其他坏扇区影响。*/
+        if (buffer_drive == current_drive && buffer_type == floppy &&
+            buffer_track == track) {
+            copy_buffer(floppy_track_buffer + ((CURRENT->sector %
+                (floppy->sect * floppy->head)) << 9),CURRENT->buffer);
+            CURRENT->sector += 2;
+            CURRENT->nr_sectors -= 2;
+            end_request(1);
+            goto repeat;
+        }
         command = FD_READ;
-    else if (CURRENT->cmd == WRITE)
+        if ((read_track = !CURRENT->errors)) {
+            head = 0;
+            sector = 1;
+        }
+    } else if (CURRENT->cmd == WRITE) {
         command = FD_WRITE;
-    else
+        read_track = 0;
+        if (buffer_drive == current_drive && buffer_track == track)
+            buffer_drive = -1;
+    } else
         panic("do_fd_request: unknown command");
     /* 访问软驱时,软驱启动并达设定转速需一定时间。ticks_to_floppy_on
      * 函数计算该事件,当定时器超时该事件时则调用floppy_on_interrupt
-     * 调度软盘请求。add_timer和ticks_to_floppy_on在sched.c中,届时阅读。*/
-    add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
+     * 调度软盘请求。时间轮和ticks_to_floppy_on在sched.c中,届时阅读。*/
+    blk_trace(BT_DISPATCH,CURRENT->dev,CURRENT->cmd,CURRENT->sector,
+        read_track ? floppy->sect * floppy->head : 2);
+    fd_delay(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
 }
 
 /* floppy_init,
@@ -39,12 +39,25 @@ inb_p(0x71); \
 #define MAX_ERRORS 7 /* 访问硬盘允许的最大次数 */
 #define MAX_HD     2 /* 硬盘数 */
 
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
 static void recal_intr(void);
+static void hd_identify(int drive);
+static void dma_intr(void);
 
 /* 硬盘校正和复位标志 */
 static int recalibrate = 1;
 static int reset = 1;
 
+/* 已下发给硬盘的读写命令中还未传输的扇区数。
+ * 合并后的请求可能超出分区末尾, 此时命令只覆盖分区内的扇区,
+ * 剩余部分由do_hd_request再次检查时以失败结束。*/
+static unsigned int cmd_sectors = 0;
+/* 多扇区读写命令每次中断传输的扇区数(单扇区读写时为1),
+ * 及最近一次中断所传输(写时为已写出待确认)的扇区数。*/
+static unsigned int cmd_mult = 1;
+static unsigned int cmd_block = 0;
+
 /*
  *  This struct defines the HD's and their types.
  */
@@ -56,6 +69,9 @@ struct hd_i_struct {
     /* 磁头数;每磁道扇区数;磁道数;
      * 预补偿柱面号,...*/
     int head,sect,cyl,wpcom,lzone,ctl;
+    int mult; /* 多扇区读写每组扇区数, 0为不使用多扇区读写 */
+    int dma;  /* 非0时以总线主控DMA方式读写 */
+    int lba;  /* 寻址方式: 0-CHS, 28-LBA28, 48-LBA48 */
 };
 /* 硬盘参数结构体数组 */
 #ifdef HD_TYPE /* 程序指定具体的硬盘参数(见config.h) */
@@ -66,6 +82,29 @@ struct hd_i_struct hd_info[] = { {0,0,0,0,0,0},{0,0,0,0,0,0} };
 static int NR_HD = 0;
 #endif
 
+/* 多扇区读写每组扇区数的上限 */
+#define HD_MAX_MULT 16
+
+/* 各硬盘WIN_IDENTIFY命令返回的标识信息, 见hd_identify */
+static struct hd_driveid hd_ident[MAX_HD];
+
+/* 硬盘复位后需为各硬盘(按位)重新设置多扇区读写每组扇区数 */
+static int setmult = 0;
+
+/* PCI总线主控IDE DMA(PIIX兼容), 只用于主通道(0x1f0)。
+ * hd_dma_base为总线主控寄存器的I/O基址, 0表示没有可用的总线主控
+ * IDE控制器, 此时硬盘只以PIO方式读写。
+ * hd_prdt为PRD表, 每项两个long: 内存物理地址, 字节数(最高位标识
+ * 最后一项)。每项不可跨越64Kb边界。*/
+#define BM_COMMAND 0 /* bit0-启动DMA, bit3-从硬盘读(写内存) */
+#define BM_STATUS  2 /* bit0-DMA进行中, bit1-出错, bit2-中断, 后两位写1清除 */
+#define BM_PRDT    4 /* PRD表物理地址 */
+#define PRD_EOT 0x80000000
+
+static unsigned int hd_dma_base = 0;
+static unsigned long * hd_prdt = NULL;
+static unsigned int dma_sectors = 0;
+
 /* struct hd_struct,
  * 硬盘分区信息结构体类型及硬盘分区信息全局数组。*/
 static struct hd_struct {
@@ -197,6 +236,10 @@ int sys_setup(void * BIOS)
         hd[i*5].start_sect = 0;
         hd[i*5].nr_sects = 0;
     }
+    /* 读取各硬盘标识信息并开启多扇区读写 */
+    for (drive=0 ; drive<NR_HD ; drive++)
+        hd_identify(drive);
+
     /* 读取硬盘分区信息(被包含在引导区中)到hd数组中保存 */
     for (drive=0 ; drive<NR_HD ; drive++) {
         if (!(bh = bread(0x300 + drive*5,0))) {
@@ -265,9 +308,10 @@ static void hd_out(unsigned int drive,unsigned int nsect,unsigned int sect,
 {
     register int port asm("dx");
 
-    /* 硬盘只有2个(0,1);硬盘的柱面数为15;
+    /* 硬盘只有2个(0,1);硬盘的磁头号最大为15(LBA寻址时
+     * head为LBA_FLAG和扇区号的27..24位);
      * 检查硬盘控制器是否就绪。*/
-    if (drive>1 || head>15)
+    if (drive>1 || (head & ~LBA_FLAG)>15)
         panic("Trying to write bad sector");
     if (!controller_ready())
         panic("HD controller not ready");
@@ -310,6 +354,57 @@ static void hd_out(unsigned int drive,unsigned int nsect,unsigned int sect,
     outb(cmd,++port); /* 如cmd=30h,写 */
 }
 
+/* hd_out_block,
+ * 给drive对应硬盘下发从硬盘绝对扇区号block开始的nsect个扇区的读写命令。
+ * 按该硬盘的寻址方式填写扇区号: LBA28时扇区号的0..7, 8..23, 24..27位
+ * 分别写入扇区号、柱面号和磁头号寄存器; LBA48时先写入扇区数和扇区号的
+ * 高位字节, 读写命令换为对应的EXT命令; 只有不支持LBA的老式硬盘才需要
+ * 按硬盘参数换算柱面、磁头和扇区号。*/
+static void hd_out_block(unsigned int drive,unsigned int nsect,
+        unsigned long block,unsigned int cmd,void (*intr_addr)(void))
+{
+    unsigned int sec,head,cyl;
+
+    switch (hd_info[drive].lba) {
+    case 48:
+        if (!controller_ready())
+            panic("HD controller not ready");
+        outb_p(nsect>>8,HD_NSECTOR);
+        outb_p(block>>24,HD_SECTOR);
+        outb_p(0,HD_LCYL);
+        outb_p(0,HD_HCYL);
+        switch (cmd) {
+            case WIN_READ:      cmd = WIN_READ_EXT; break;
+            case WIN_WRITE:     cmd = WIN_WRITE_EXT; break;
+            case WIN_MULTREAD:  cmd = WIN_MULTREAD_EXT; break;
+            case WIN_MULTWRITE: cmd = WIN_MULTWRITE_EXT; break;
+            case WIN_READDMA:   cmd = WIN_READDMA_EXT; break;
+            case WIN_WRITEDMA:  cmd = WIN_WRITEDMA_EXT; break;
+        }
+        sec = block & 0xff;
+        cyl = (block >> 8) & 0xffff;
+        head = LBA_FLAG;
+        break;
+    case 28:
+        sec = block & 0xff;
+        cyl = (block >> 8) & 0xffff;
+        head = LBA_FLAG | ((block >> 24) & 0x0f);
+        break;
+    default:
+        /* 计算逻辑扇区号block对应的磁道和在该磁道上的扇区号,
+         * 计算结果为block=磁道号,sec=在block磁道上的扇区号。
+         *
+         * 计算磁道号block对应的柱面号和磁头号,
+         * 计算结果为cyl=柱面号,head=磁头号。*/
+        __asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
+            "r" (hd_info[drive].sect));
+        __asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
+            "r" (hd_info[drive].head));
+        sec++; /* 扇区号从1开始 */
+    }
+    hd_out(drive,nsect,sec,head,cyl,cmd,intr_addr);
+}
+
 /* drive_busy,
  * 多次获取硬盘主状态控制器的状态,
  * 若在规定次数中主状态控制器状态
@@ -350,12 +445,79 @@ static void reset_controller(void)
         printk("HD-controller reset failed: %02x\n\r",i);
 }
 
+/* wait_not_busy,
+ * 轮询等待硬盘控制器不忙, 返回此时的硬盘状态。*/
+static int wait_not_busy(void)
+{
+    int i, r = BUSY_STAT;
+
+    for (i = 0 ; i < 100000 && ((r = inb_p(HD_STATUS)) & BUSY_STAT) ; i++)
+        /* nothing */ ;
+    return r;
+}
+
+/* hd_identify,
+ * 以轮询方式(置控制寄存器nIEN位, 硬盘不产生中断)向drive硬盘下发
+ * WIN_IDENTIFY命令, 读取其标识信息到hd_ident[drive]中; 若硬盘支持
+ * 多扇区读写, 则以WIN_SETMULT设置每组扇区数并记录在hd_info[drive].mult
+ * 中。不支持这两个命令的老式硬盘仍使用单扇区读写。
+ * 只在sys_setup中硬盘还没有读写请求时调用。*/
+static void hd_identify(int drive)
+{
+    struct hd_driveid * id = hd_ident + drive;
+    int r, mult;
+
+    hd_info[drive].mult = 0;
+    hd_info[drive].lba = 0;
+    outb_p(hd_info[drive].ctl | 2,HD_CMD);
+    outb_p(0xA0|(drive<<4),HD_CURRENT);
+    if (!controller_ready())
+        goto out;
+    outb(WIN_IDENTIFY,HD_COMMAND);
+    r = wait_not_busy();
+    if ((r & (BUSY_STAT | ERR_STAT | DRQ_STAT)) != DRQ_STAT)
+        goto out;
+    port_read(HD_DATA,id,256);
+    hd_info[drive].dma = hd_dma_base && (id->capability & 1);
+    /* 支持LBA的硬盘以LBA寻址, 容量超出LBA28时才用LBA48, 整个硬盘
+     * 的扇区数取自标识信息而非BIOS参数(后者最多只能表示504Mb)。
+     * BIOS参数可能是经转换的磁头数大于16的参数, 复位时WIN_SPECIFY
+     * 改用硬盘自身的默认参数。*/
+    if (id->capability & 2) {
+        hd_info[drive].head = id->heads;
+        hd_info[drive].sect = id->sectors;
+        hd_info[drive].cyl = id->cyls;
+        hd_info[drive].lba = 28;
+        hd[drive*5].nr_sects = id->lba_capacity;
+        if ((id->command_set_2 & (1<<10)) &&
+            (id->lba_capacity_2[1] || id->lba_capacity_2[0] > 0x0fffffff)) {
+            hd_info[drive].lba = 48;
+            hd[drive*5].nr_sects = (id->lba_capacity_2[1] ||
+                id->lba_capacity_2[0] > 0x7fffffff) ?
+                0x7fffffff : id->lba_capacity_2[0];
+        }
+    }
+    if ((mult = id->max_multsect) > HD_MAX_MULT)
+        mult = HD_MAX_MULT;
+    if (mult < 2)
+        goto out;
+    outb_p(mult,HD_NSECTOR);
+    outb_p(0xA0|(drive<<4),HD_CURRENT);
+    outb(WIN_SETMULT,HD_COMMAND);
+    r = wait_not_busy();
+    if (!(r & (BUSY_STAT | ERR_STAT)))
+        hd_info[drive].mult = mult;
+out:
+    outb_p(hd_info[drive].ctl,HD_CMD);
+}
+
 /* reset_hd,
  * 以指定硬盘参数表设置硬盘。*/
 static void reset_hd(int nr)
 {
     /* 复位硬盘驱动器,下发以硬盘参数表信息重新建立控制器参数HDC命令 */
     reset_controller();
+    setmult = (1<<MAX_HD)-1;
     hd_out(nr,hd_info[nr].sect,hd_info[nr].sect,hd_info[nr].head-1,
         hd_info[nr].cyl,WIN_SPECIFY,&recal_intr);
 }
@@ -394,27 +556,57 @@ static void read_intr(void)
         do_hd_request();
         return;
     }
-    /* 从硬盘数据寄存器中读取一扇区内容到buffer中,
+    /* 每次中断可读一组(单扇区读写时为1个)扇区。
+     * 逐扇区从硬盘数据寄存器中读取内容到buffer中,
      * 读成功后复位读设备失败次数,存储硬盘数据缓冲
      * 区后移一扇区大小,更新当前所在扇区以及未读扇
      * 区数。当未读扇区数不为0时,中断请求函数仍设置
      * 为硬盘中断读函数并返回。*/
-    port_read(HD_DATA,CURRENT->buffer,256);
-    CURRENT->errors = 0;
-    CURRENT->buffer += 512;
-    CURRENT->sector++;
-    if (--CURRENT->nr_sectors) {
+    cmd_block = MIN(cmd_sectors,cmd_mult);
+    cmd_sectors -= cmd_block;
+    while (cmd_block--) {
+        port_read(HD_DATA,CURRENT->buffer,256);
+        CURRENT->errors = 0;
+        CURRENT->buffer += 512;
+        CURRENT->sector++;
+        CURRENT->nr_sectors--;
+        /* 读完一个缓冲区块(扇区号回到偶数)时结束该缓冲区块,
+         * end_request会让请求指向请求中的下一个缓冲区块, 读
+         * 完请求中最后一个缓冲区块时则结束当前请求。*/
+        if (!(CURRENT->sector & 1))
+            end_request(1);
+    }
+    if (cmd_sectors) {
         do_hd = &read_intr;
         return;
     }
-    /* 执行到这里时,当前请求未读扇区已为0,
-     * 所以正常结束当前请求,并设置当前块设备
-     * 请求指向下一请求并调用do_hd_request调
-     * 度块设备下一请求。*/
-    end_request(1);
+    /* 执行到这里时,本次读命令的扇区已读完,
+     * 调用do_hd_request调度当前请求的剩余
+     * 部分或块设备下一请求。*/
     do_hd_request();
 }
 
+/* write_sectors,
+ * 向硬盘写出一组(至多cmd_mult个)扇区, 扇区数记录在cmd_block中。
+ * 一组扇区可能跨越请求中的多个缓冲区块, 此处只沿b_reqnext读取
+ * 各缓冲区块内容, 请求的状态要等硬盘以中断确认写成功后才更新。*/
+static void write_sectors(void)
+{
+    struct buffer_head * bh = CURRENT->bh;
+    char * buf = CURRENT->buffer;
+    int i;
+
+    cmd_block = MIN(cmd_sectors,cmd_mult);
+    for (i = 0 ; i < cmd_block ; i++) {
+        if (bh && buf == bh->b_data + BLOCK_SIZE && bh->b_reqnext) {
+            bh = bh->b_reqnext;
+            buf = bh->b_data;
+        }
+        port_write(HD_DATA,buf,256);
+        buf += 512;
+    }
+}
+
 /* write_intr,
  * 写硬盘中断C处理函数。
  * 当前写块设备请求完成时调度下一请求,
@@ -433,22 +625,108 @@ static void write_intr(void)
         return;
     }
 
-    /* 因为在do_hd_request中已写过一扇区,所以此处
-     * 先将未写扇区数减1后再判断是否为0。若不为0则
-     * 更新已读硬盘当前所在扇区号,更新缓冲区块位置,
-     * 继续设置do_hd为写中断处理函数write_intr,并再
-     * 写块设备一扇区内容并返回。*/
-    if (--CURRENT->nr_sectors) {
+    /* 本次中断表明上次写出的一组(cmd_block个)扇区已写成功,
+     * 逐扇区更新已写硬盘当前所在扇区号,更新缓冲区块位置。
+     * 若还有未写扇区, 则继续设置do_hd为写中断处理函数
+     * write_intr,并再写块设备一组扇区内容并返回。*/
+    cmd_sectors -= cmd_block;
+    while (cmd_block--) {
+        CURRENT->errors = 0;
         CURRENT->sector++;
         CURRENT->buffer += 512;
+        CURRENT->nr_sectors--;
+        /* 写完一个缓冲区块时结束该缓冲区块并转到请求中的下一个缓冲区块 */
+        if (!(CURRENT->sector & 1))
+            end_request(1);
+    }
+    if (cmd_sectors) {
         do_hd = &write_intr;
-        port_write(HD_DATA,CURRENT->buffer,256);
+        write_sectors();
         return;
     }
-    /* 执行到此处表明当前写硬盘请求已完成,
-     * 所以正常结束当前写块设备请求并调整当
-     * 前硬盘请求指向下一请求;然后调用do_hd_request继续调度。*/
-    end_request(1);
+    /* 执行到此处表明本次写命令已完成,
+     * 调用do_hd_request调度当前请求的剩余
+     * 部分或块设备下一请求。*/
+    do_hd_request();
+}
+
+/* setmult_intr,
+ * 硬盘复位后重新设置多扇区读写每组扇区数的中断处理,
+ * 若设置失败则该硬盘改用单扇区读写。*/
+static void setmult_intr(void)
+{
+    if (win_result())
+        hd_info[CURRENT_DEV].mult = 0;
+    do_hd_request();
+}
+
+/* dma_start,
+ * 以总线主控DMA方式传输当前请求的nsect个扇区。沿请求中的缓冲区块
+ * 链建立PRD表(内存地址连续的相邻缓冲区块合为一项), 向硬盘下发DMA
+ * 读写命令后启动总线主控器。整个传输只在完成时产生一次中断。*/
+static void dma_start(unsigned int drive,unsigned int nsect,unsigned long block)
+{
+    struct buffer_head * bh = CURRENT->bh;
+    unsigned long addr = (unsigned long) CURRENT->buffer;
+    unsigned long len, left = nsect << 9;
+    unsigned long * prd = hd_prdt;
+
+    while (left) {
+        len = bh ? (unsigned long) bh->b_data + BLOCK_SIZE - addr : left;
+        if (len > left)
+            len = left;
+        if (prd != hd_prdt && prd[-2] + prd[-1] == addr &&
+            prd[-1] + len < 0x10000 &&
+            (prd[-2] >> 16) == ((addr + len - 1) >> 16))
+            prd[-1] += len;
+        else {
+            *prd++ = addr;
+            *prd++ = len;
+        }
+        left -= len;
+        if (!bh || !(bh = bh->b_reqnext))
+            break;
+        addr = (unsigned long) bh->b_data;
+    }
+    prd[-1] |= PRD_EOT;
+    dma_sectors = nsect - (left >> 9);
+
+    outl((unsigned long) hd_prdt,hd_dma_base + BM_PRDT);
+    outb_p(CURRENT->cmd == READ ? 8 : 0,hd_dma_base + BM_COMMAND);
+    outb_p(inb_p(hd_dma_base + BM_STATUS) | 6,hd_dma_base + BM_STATUS);
+    hd_out_block(drive,dma_sectors,block,
+        CURRENT->cmd == READ ? WIN_READDMA : WIN_WRITEDMA,&dma_intr);
+    outb(CURRENT->cmd == READ ? 9 : 1,hd_dma_base + BM_COMMAND);
+}
+
+/* dma_intr,
+ * DMA读写完成中断C处理函数。停止总线主控器并清其中断状态,
+ * 成功时一并结束已传输的各扇区所在缓冲区块; 总线主控器报告
+ * 出错时该硬盘改用PIO方式读写, 并按失败重试当前请求。*/
+static void dma_intr(void)
+{
+    int st, i;
+
+    st = inb_p(hd_dma_base + BM_STATUS);
+    outb_p(0,hd_dma_base + BM_COMMAND);
+    outb_p(st | 6,hd_dma_base + BM_STATUS);
+    if (st & 2) {
+        printk("hd%d: DMA error, using PIO\n\r",CURRENT_DEV);
+        hd_info[CURRENT_DEV].dma = 0;
+    }
+    if ((st & 2) || win_result()) {
+        bad_rw_intr();
+        do_hd_request();
+        return;
+    }
+    for (i = dma_sectors ; i > 0 ; i--) {
+        CURRENT->errors = 0;
+        CURRENT->buffer += 512;
+        CURRENT->sector++;
+        CURRENT->nr_sectors--;
+        if (!(CURRENT->sector & 1))
+            end_request(1);
+    }
     do_hd_request();
 }
 
@@ -486,7 +764,6 @@ void do_hd_request(void)
 {
     int i,r;
     unsigned int block,dev;
-    unsigned int sec,head,cyl;
     unsigned int nsect;
 
     /* 检查当前对硬盘的请求是否合理 */
@@ -505,17 +782,10 @@ void do_hd_request(void)
      * dev/5计算得到硬盘0还是硬盘1。*/
     block += hd[dev].start_sect;
     dev /= 5;
-    /* 计算逻辑扇区号block对应的磁道和在该磁道上的扇区号,
-     * 计算结果为block=磁道号,sect=在block磁道上的扇区号。
-     *
-     * 计算磁道号block对应的柱面号和磁头号,
-     * 计算结果为cyl=柱面号,head=磁头号。*/
-    __asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
-        "r" (hd_info[dev].sect));
-    __asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
-        "r" (hd_info[dev].head));
-    sec++; /* 扇区号从1开始 */
-    nsect = CURRENT->nr_sectors; /* 获取欲读写扇区数 */
+    /* 获取欲读写扇区数, 合并后的请求不得越过分区末尾 */
+    nsect = CURRENT->nr_sectors;
+    if (CURRENT->sector + nsect > hd[MINOR(CURRENT->dev)].nr_sects)
+        nsect = hd[MINOR(CURRENT->dev)].nr_sects - CURRENT->sector;
 
     /* 若硬盘重置信号置位则重置硬盘,
      * 并将硬盘重新校正置位。*/
@@ -532,10 +802,27 @@ void do_hd_request(void)
             WIN_RESTORE,&recal_intr);
         return;
     }
+    /* 硬盘复位后重新设置多扇区读写每组扇区数 */
+    if (setmult & (1<<dev)) {
+        setmult &= ~(1<<dev);
+        if (hd_info[dev].mult) {
+            hd_out(dev,hd_info[dev].mult,0,0,0,WIN_SETMULT,&setmult_intr);
+            return;
+        }
+    }
+    blk_trace(BT_DISPATCH,CURRENT->dev,CURRENT->cmd,CURRENT->sector,nsect);
+    /* 硬盘支持DMA时以总线主控DMA方式传输 */
+    if (hd_info[dev].dma) {
+        dma_start(dev,nsect,block);
+        return;
+    }
+    cmd_sectors = nsect;
+    cmd_mult = hd_info[dev].mult ? hd_info[dev].mult : 1;
     /* 若当前请求是请求写设备, */
     if (CURRENT->cmd == WRITE) {
         /* 则向硬盘下发写命令块并传入写硬盘中断的C处理回调函数write_intr */
-        hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
+        hd_out_block(dev,nsect,block,
+            cmd_mult > 1 ? WIN_MULTWRITE : WIN_WRITE,&write_intr);
         /* 检查向硬盘下发的写命令是否成功,若失败则回到INIT_REQUEST中repeat处 */
         for(i=0 ; i<3000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
             /* nothing */ ;
@@ -543,17 +830,55 @@ void do_hd_request(void)
             bad_rw_intr();
             goto repeat;
         }
-        /* 若向硬盘下发的写命令成功,则先写入一扇区数据 */
-        port_write(HD_DATA,CURRENT->buffer,256);
+        /* 若向硬盘下发的写命令成功,则先写入一组扇区数据 */
+        write_sectors();
 
     /* 若当前请求是请求读设备, */
     } else if (CURRENT->cmd == READ) {
         /* 则向硬盘下发读命令块并传入读硬盘中断的C处理函数read_intr */
-        hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
+        hd_out_block(dev,nsect,block,
+            cmd_mult > 1 ? WIN_MULTREAD : WIN_READ,&read_intr);
     } else
         panic("unknown hd-command");
 }
 
+/* hd_dma_probe,
+ * 通过PCI配置空间(机制1, 端口0xCF8/0xCFC)在0号总线上寻找主通道
+ * 工作在兼容模式且支持总线主控的IDE控制器(如PIIX), 开启其总线主控
+ * 并记录总线主控寄存器基址(BAR4), 为PRD表分配一页内存。*/
+static void hd_dma_probe(void)
+{
+    unsigned long addr, class, bar;
+    int dev, fn;
+
+    for (dev = 0 ; dev < 32 ; dev++)
+        for (fn = 0 ; fn < 8 ; fn++) {
+            addr = 0x80000000 | (dev << 11) | (fn << 8);
+            outl(addr,0xCF8);
+            if ((inl(0xCFC) & 0xffff) == 0xffff)
+                continue;
+            /* 类别0x01(大容量存储), 子类0x01(IDE), 编程接口bit7-总线
+             * 主控, bit0-主通道工作在PCI本地模式(端口不在0x1f0) */
+            outl(addr | 0x08,0xCF8);
+            class = inl(0xCFC);
+            if ((class >> 16) != 0x0101 || !(class & 0x8000) ||
+                (class & 0x100))
+                continue;
+            outl(addr | 0x20,0xCF8);
+            if (!((bar = inl(0xCFC)) & 1))
+                continue;
+            if (!(hd_prdt = (unsigned long *) get_free_page()))
+                return;
+            /* 命令寄存器: bit0-I/O空间, bit2-总线主控 */
+            outl(addr | 0x04,0xCF8);
+            class = inl(0xCFC) & 0xffff;
+            outl(addr | 0x04,0xCF8);
+            outl(class | 5,0xCFC);
+            hd_dma_base = bar & 0xfffc;
+            return;
+        }
+}
+
 /* [2] hd_init,
  * 设置硬盘的读写请求函数,
  * 设置硬盘中断处理函数,使能硬盘中断。*/
@@ -565,6 +890,9 @@ void hd_init(void)
      * 为do_hd_request函数。*/
     blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
 
+    /* 探测PCI总线主控IDE控制器, 没有时硬盘只以PIO方式读写 */
+    hd_dma_probe();
+
     /* 在IDT[0x2E]中设定硬盘中断处理函数,
      * 8259A-2 IRQ7对应硬盘中断,IRQ7中断
      * 号在setup.s中被设置为0x2e。*/
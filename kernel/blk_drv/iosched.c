@@ -0,0 +1,211 @@
+/*
+ *  linux/kernel/blk_drv/iosched.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/* iosched.c 包含块设备请求调度器, 由blk_dev[]中各块设备的sched选用。
+ *
+ * elevator - 原电梯算法, 读请求排在写请求之前, 同方向按扇区升序;
+ * cscan    - C-SCAN, 不分读写按(设备分区号, 扇区号)单向升序扫描,
+ *            扫到最后再从最小的扇区号开始;
+ * deadline - 按C-SCAN排序, 另为读写请求各维护一个按到达先后排列的
+ *            FIFO, 每个请求带有到期时刻(读READ_EXPIRE, 写WRITE_EXPIRE),
+ *            有请求到期时(先看读)优先处理最早到期的请求, 以免大量
+ *            写请求使读请求久等。
+ *
+ * 各设备的默认调度器在blk_dev[]中选定, 可由系统调用iosched在设备
+ * 请求队列为空时更换。*/
+
+#include <errno.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <sys/iostat.h>
+
+#include "blk.h"
+
+/* deadline调度器中读写请求的到期时间 */
+#define READ_EXPIRE  (HZ/2)
+#define WRITE_EXPIRE (5*HZ)
+
+/*
+ * add-request adds a request to the linked list.
+ */
+/* elevator_add,
+ * 以电梯升梯调度算法将req加入设备dev的请求链表中。*/
+static void elevator_add(struct blk_dev_struct * dev, struct request * req)
+{
+    struct request * tmp = dev->current_request;
+
+    /* 按照电梯升梯算法将req指向的请求加入到该设备的
+     * 所有请求中形成一个各楼层等待乘梯上楼式的链表。*/
+    for ( ; tmp->next ; tmp=tmp->next)
+        /* 以IN_ORDER指定优先级判定,若新
+         * 加入的req请求的优先级比tmp请求
+         * 优先级低,则以优先级降序顺序寻找
+         * req指向请求的位置,即满足优先级
+         * tmp > req > tmp->next。
+         *
+         * 若新加入的req请求优先级高于或等于
+         * tmp请求,则req会加入到优先级都比tmp
+         * 请求高的链表序列中,在这个序列中仍
+         * 以IN_ORDER所指定优先级的降序方式将
+         * req插入其中,待tmp所在序列中的所有序
+         * 列都调度完毕后再调度比tmp优先级高的
+         * 序列。这就像电梯到了3楼(tmp),所有高
+         * 于3楼的要乘梯继续往上的都可以乘梯,所
+         * 有低于3楼的要乘梯往上的只有当电梯重新
+         * 回到有人往上的最低楼层后才又逐层往上走。
+         *
+         * 使用电梯调度算法是为了在调度各读写磁盘的
+         * 请求时,每次都尽可能少地移动磁盘(磁头等)。*/
+        if ((IN_ORDER(tmp,req) ||
+            !IN_ORDER(tmp,tmp->next)) &&
+            IN_ORDER(req,tmp->next))
+            break;
+    /* 将新请求插入到链表中的合适位置以待调度请求读写设备 */
+    req->next=tmp->next;
+    tmp->next=req;
+}
+
+struct blk_sched elevator_sched = { "elevator", elevator_add, NULL };
+
+/* 磁头扫描顺序: 设备分区号小者在前, 同一分区扇区号小者在前 */
+#define SCAN_ORDER(s1,s2) \
+((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
+(s1)->sector < (s2)->sector))
+
+/* cscan_add,
+ * 将req按C-SCAN顺序加入设备dev的请求链表中。
+ * 链表由若干段按SCAN_ORDER升序的扫描组成, req插入到第一个
+ * 能容纳它的位置: 在tmp之后且在tmp->next之前, 或tmp为本次扫描
+ * 的最后一个请求而req在下次扫描的第一个请求之前。*/
+static void cscan_add(struct blk_dev_struct * dev, struct request * req)
+{
+    struct request * tmp = dev->current_request;
+
+    for ( ; tmp->next ; tmp=tmp->next)
+        if ((SCAN_ORDER(tmp,req) ||
+            !SCAN_ORDER(tmp,tmp->next)) &&
+            SCAN_ORDER(req,tmp->next))
+            break;
+    req->next=tmp->next;
+    tmp->next=req;
+}
+
+struct blk_sched cscan_sched = { "cscan", cscan_add, NULL };
+
+/* fifo_add,
+ * 将req加入设备dev中与其读写方向相同的FIFO尾部。*/
+static void fifo_add(struct blk_dev_struct * dev, struct request * req)
+{
+    struct request ** head = dev->fifo + req->cmd;
+
+    if (!*head) {
+        *head = req->fifo_next = req->fifo_prev = req;
+        return;
+    }
+    req->fifo_next = *head;
+    req->fifo_prev = (*head)->fifo_prev;
+    (*head)->fifo_prev->fifo_next = req;
+    (*head)->fifo_prev = req;
+}
+
+/* fifo_remove,
+ * 若req在其FIFO中则将其移除。*/
+static void fifo_remove(struct blk_dev_struct * dev, struct request * req)
+{
+    struct request ** head = dev->fifo + req->cmd;
+
+    if (!req->fifo_next)
+        return;
+    if (req->fifo_next == req)
+        *head = NULL;
+    else {
+        req->fifo_prev->fifo_next = req->fifo_next;
+        req->fifo_next->fifo_prev = req->fifo_prev;
+        if (*head == req)
+            *head = req->fifo_next;
+    }
+    req->fifo_next = req->fifo_prev = NULL;
+}
+
+/* deadline_add,
+ * 按C-SCAN顺序将req加入请求链表, 并设置其到期时刻后加入FIFO。*/
+static void deadline_add(struct blk_dev_struct * dev, struct request * req)
+{
+    cscan_add(dev,req);
+    req->expires = jiffies + (req->cmd == READ ? READ_EXPIRE : WRITE_EXPIRE);
+    fifo_add(dev,req);
+}
+
+/* deadline_dispatch,
+ * 在队列头部请求结束时调用。请求在其结束前都留在FIFO中,
+ * 所以先将结束的请求移出FIFO; 然后若读(其次写)FIFO头部的请求
+ * 已到期, 则将其移到队列头部之后作为下一个被处理的请求。*/
+static void deadline_dispatch(struct blk_dev_struct * dev)
+{
+    struct request * cur = dev->current_request;
+    struct request * req, * tmp;
+
+    fifo_remove(dev,cur);
+    if (!(req = dev->fifo[READ]) || (long) (jiffies - req->expires) < 0)
+        if (!(req = dev->fifo[WRITE]) || (long) (jiffies - req->expires) < 0)
+            return;
+    if (cur->next == req)
+        return;
+    for (tmp = cur ; tmp->next ; tmp = tmp->next)
+        if (tmp->next == req) {
+            tmp->next = req->next;
+            req->next = cur->next;
+            cur->next = req;
+            return;
+        }
+}
+
+struct blk_sched deadline_sched = { "deadline", deadline_add, deadline_dispatch };
+
+/* 可选的调度器, 下标为<sys/iostat.h>中的IOSCHED_*编号 */
+static struct blk_sched * sched_table[] = {
+    &elevator_sched,    /* IOSCHED_ELEVATOR */
+    &cscan_sched,       /* IOSCHED_CSCAN */
+    &deadline_sched     /* IOSCHED_DEADLINE */
+};
+
+#define NR_SCHED ((sizeof (sched_table))/(sizeof (struct blk_sched *)))
+
+/* sys_iosched,
+ * 将主设备号为major的块设备的请求调度器换为第sched个调度器, 返回原
+ * 调度器的编号; sched为负时只返回当前调度器的编号。
+ *
+ * 调度器在请求入队时排列请求(deadline还在请求项中维护FIFO), 队列中
+ * 的请求只能由排列它们的调度器处理, 所以只在设备请求队列为空(也未被
+ * 堵塞)时在禁止中断的情况下更换, 否则返回-EBUSY。*/
+int sys_iosched(int major, int sched)
+{
+    struct blk_dev_struct * dev;
+    int old;
+
+    if (major <= 0 || major >= NR_BLK_DEV || !blk_dev[major].request_fn)
+        return -ENODEV;
+    dev = blk_dev + major;
+    for (old = 0 ; old < NR_SCHED ; old++)
+        if (sched_table[old] == dev->sched)
+            break;
+    if (sched < 0)
+        return old;
+    if (sched >= NR_SCHED)
+        return -EINVAL;
+    if (!suser())
+        return -EPERM;
+    cli();
+    if (dev->current_request) {
+        sti();
+        return -EBUSY;
+    }
+    dev->sched = sched_table[sched];
+    sti();
+    return old;
+}
@@ -0,0 +1,97 @@
+/*
+ *  linux/kernel/blk_drv/iostat.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/* iostat.c 统计各块设备请求的延迟。
+ *
+ * 请求在入队(make_request)、到达队列头部开始处理(add_request,
+ * unplug_device, end_request)和完成(end_request)时各记一次时刻,
+ * 完成时将排队时间和处理时间按对数分桶计入该请求所在设备(主、
+ * 次设备号)的直方图中, 用户程序经系统调用iostat读取。
+ *
+ * 时刻以微秒计(见sched_clock), 精度远高于一个时钟滴答。32位微秒值
+ * 约71分钟回绕一次, 只用于求差值。*/
+
+#include <errno.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+#include <sys/iostat.h>
+
+#include "blk.h"
+
+/* 最多统计的块设备数, 设备在其第一个请求完成时取得一项 */
+#define NR_IOSTAT 16
+
+static struct iostat blk_stats[NR_IOSTAT];
+
+/* blk_clock,
+ * 返回以微秒计的当前时刻, 即sched_clock(): 有TSC时由TSC换算, 否则
+ * 由jiffies和定时器0的剩余计数值合成。可在中断中调用。*/
+unsigned long blk_clock(void)
+{
+    return sched_clock();
+}
+
+/* log2_bucket,
+ * 返回延迟t(微秒)所在的直方图桶号。*/
+static inline int log2_bucket(unsigned long t)
+{
+    int i;
+
+    if (!t)
+        return 0;
+    __asm__("bsrl %1,%0":"=r" (i):"r" (t));
+    return i;
+}
+
+/* iostat_done,
+ * 在请求req完成时(end_request中)调用, 将其排队时间和处理时间计入
+ * 其设备的直方图, 返回当前时刻供下一个请求作为开始处理的时刻。*/
+unsigned long iostat_done(struct request * req)
+{
+    struct iostat * st;
+    unsigned long now = blk_clock();
+
+    for (st = blk_stats ; st < blk_stats + NR_IOSTAT ; st++)
+        if (st->dev == req->dev || !st->dev)
+            break;
+    if (st >= blk_stats + NR_IOSTAT)
+        return now;
+    st->dev = req->dev;
+    if (req->cmd == READ)
+        st->reads++;
+    else
+        st->writes++;
+    st->wait[log2_bucket(req->dispatch_time - req->start_time)]++;
+    st->service[log2_bucket(now - req->dispatch_time)]++;
+    return now;
+}
+
+/* sys_iostat,
+ * 将第index个已有统计的块设备的统计信息, 连同其所属块设备请求项池
+ * 的状态(见blk_dev_struct), 拷贝到用户缓冲区buf中。*/
+int sys_iostat(int index, struct iostat * buf)
+{
+    struct iostat st;
+    struct blk_dev_struct * dev;
+
+    if (index < 0 || index >= NR_IOSTAT || !blk_stats[index].dev)
+        return -EINVAL;
+    verify_area(buf,sizeof(struct iostat));
+    /* 先在禁止中断时取一份完整的快照 */
+    cli();
+    st = blk_stats[index];
+    dev = blk_dev + MAJOR(st.dev);
+    st.nr_requests = dev->nr_requests;
+    st.nr_free = dev->nr_free;
+    st.nr_writes = dev->nr_writes;
+    st.congested = dev->nr_congested;
+    sti();
+    memcpy_tofs(buf,&st,sizeof(struct iostat));
+    return 0;
+}
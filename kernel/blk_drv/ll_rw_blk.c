@@ -19,17 +19,17 @@
  * The request-struct contains all necessary data
  * to load a nr of sectors into memory
  */
-/* 管理块设备读写请求结构体类型的全局数组,struct request
- * 结构体类型中包含了加载 nr 扇区到内存的必要成员。*/
-struct request request[NR_REQUEST];
-
-/*
- * used to wait on when there are no free requests
- */
-/* 用于进程等待空闲的 request 结构体元素 */
-/* 在块设备请求数组request无空闲元素时,
- * 用于等待直到request中出现空闲元素。*/
-struct task_struct * wait_for_request = NULL;
+/* 各块设备请求项池的基本大小(请求项数)。块设备各自拥有请求项池,
+ * 一个设备请求繁忙时不会占用其他设备的请求项。blk_dev_init在内存
+ * 多于8Mb时将其加倍, 但一个池不超过一页内存。
+ * 虚拟盘请求同步完成, 软盘较慢, 请求项多了也无益。*/
+static int nr_requests[NR_BLK_DEV] = {
+    0,              /* no_dev */
+    NR_REQUEST/4,   /* dev mem */
+    NR_REQUEST/2,   /* dev fd */
+    NR_REQUEST,     /* dev hd */
+    0, 0, 0         /* dev ttyx, tty, lp */
+};
 
 /* blk_dev_struct is:
  *  do_request-address
@@ -38,16 +38,24 @@ struct task_struct * wait_for_request = NULL;
  /* 块设备(读写)请求结构体数组,
   * 目前只将软盘(2)和硬盘(3)当做块设备管理。
   * 他们分别在floppy.c和hd.c中被赋值。*/
+/* 各块设备的默认请求调度器也在此选定: 硬盘用deadline调度器以免大量
+ * 写请求使读请求等待过久, 软盘用C-SCAN调度器, 其余用原电梯算法。
+ * 运行时可由系统调用iosched更换(见iosched.c)。*/
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
-    { NULL, NULL }, /* no_dev */
-    { NULL, NULL }, /* dev mem */
-    { NULL, NULL }, /* dev fd */
-    { NULL, NULL }, /* dev hd */
-    { NULL, NULL }, /* dev ttyx */
-    { NULL, NULL }, /* dev tty */
-    { NULL, NULL }  /* dev lp */
+    { NULL, NULL, &elevator_sched }, /* no_dev */
+    { NULL, NULL, &elevator_sched }, /* dev mem */
+    { NULL, NULL, &cscan_sched },    /* dev fd */
+    { NULL, NULL, &deadline_sched }, /* dev hd */
+    { NULL, NULL, &elevator_sched }, /* dev ttyx */
+    { NULL, NULL, &elevator_sched }, /* dev tty */
+    { NULL, NULL, &elevator_sched }  /* dev lp */
 };
 
+/* 用于堵塞(plug)各块设备请求队列的伪请求。
+ * 堵塞期间请求只入队而不启动设备, 以便一批相邻逻辑块的请求
+ * 能先合并为一个请求, 见plug_device和unplug_device。*/
+static struct request plug_request[NR_BLK_DEV];
+
 /* lock_buffer,
  * 为bh所指管理缓冲区块的节点置位锁状态,
  * 间接为bh所管理的缓冲区块上锁。*/
@@ -62,7 +70,7 @@ static inline void lock_buffer(struct buffer_head * bh)
  * 互斥访问了。这是只有在写b_lock成员时才禁止CPU处理中断的原因。*/
     cli();
     while (bh->b_lock)
-        sleep_on(&bh->b_wait);
+        sleep_on_exclusive(&bh->b_wait);
     bh->b_lock=1;
     sti();
 }
@@ -79,7 +87,7 @@ static inline void unlock_buffer(struct buffer_head * bh)
      * 所以此处不用再禁止CPU处理本进程中断。*/
     bh->b_lock = 0;
 
-    /* 唤醒调用sleep_on(&bh->b_wait)进入睡眠的进程们 */
+    /* 唤醒等待bh解锁的进程们和一个等待为bh上锁的进程 */
     wake_up(&bh->b_wait);
 }
 
@@ -91,65 +99,71 @@ static inline void unlock_buffer(struct buffer_head * bh)
 /* add_request,添加一个请求到请求链表中。
  * 该函数失能中断是为了能正确地添加请求(避免中断程序的竞争)。*/
 /* add_request,
- * 以电梯升梯调度算法管理调度某个块设备的读写请求。
  * 若设备当前无其他请求,则直接用当前设备读写请求函数(dev->request_fn)读写设备。
- * 若设备已有其他请求,则以电梯升梯算法将当前读写请求加入到该设备已有请求的链表
- * 中,以待调度执行。*/
+ * 若设备已有其他请求,则由设备的请求调度器(dev->sched, 见iosched.c)将当前读写
+ * 请求加入到该设备已有请求的链表中,以待调度执行。*/
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
-    struct request * tmp;
-
     req->next = NULL;
+    req->fifo_next = req->fifo_prev = NULL;
+    blk_trace(BT_QUEUE,req->dev,req->cmd,req->sector,req->nr_sectors);
     cli(); /* 禁止中断 */
     /* 无中断+内核无抢占模式 将使得从此处到sti()之间的程序会一直执行 */
     if (req->bh)
         req->bh->b_dirt = 0;
-    if (!(tmp = dev->current_request)) {
+    if (!dev->current_request) {
         /* 若设备无其他请求则将当前请求设置为req指向的请求,并调
          * 用挂载在request_fn上的回调函数读写设备。该函数将会向
          * 对应的设备下发读写命令,对应设备收到读写命令后,在准备
          * 好被读或被写的相关状态时会就向CPU申请被读写的中断,从
          * 而让CPU指向对应的中断函数以完成设备读写。*/
         dev->current_request = req;
+        req->dispatch_time = req->start_time;
         sti();
         (dev->request_fn)();
         return;
     }
-    /* 若设备有其他请求,则按照电梯升梯算
-     * 法将req指向的请求加入到该设备的所
-     * 有请求中形成一个各楼层等待乘梯上楼
-     * 式的链表。*/
-    for ( ; tmp->next ; tmp=tmp->next)
-        /* 以IN_ORDER指定优先级判定,若新
-         * 加入的req请求的优先级比tmp请求
-         * 优先级低,则以优先级降序顺序寻找
-         * req指向请求的位置,即满足优先级 
-         * tmp > req > tmp->next。
-         * 
-         * 若新加入的req请求优先级高于或等于
-         * tmp请求,则req会加入到优先级都比tmp
-         * 请求高的链表序列中,在这个序列中仍
-         * 以IN_ORDER所指定优先级的降序方式将
-         * req插入其中,待tmp所在序列中的所有序
-         * 列都调度完毕后再调度比tmp优先级高的
-         * 序列。这就像电梯到了3楼(tmp),所有高
-         * 于3楼的要乘梯继续往上的都可以乘梯,所
-         * 有低于3楼的要乘梯往上的只有当电梯重新
-         * 回到有人往上的最低楼层后才又逐层往上走。
-         * 
-         * 使用电梯调度算法是为了在调度各读写磁盘的
-         * 请求时,每次都尽可能少地移动磁盘(磁头等)。
-         * linux0.11只使用了电梯升梯调度算法。*/
-        if ((IN_ORDER(tmp,req) ||
-            !IN_ORDER(tmp,tmp->next)) &&
-            IN_ORDER(req,tmp->next))
-            break;
-    /* 将新请求插入到链表中的合适位置以待调度请求读写设备 */
-    req->next=tmp->next;
-    tmp->next=req;
+    (dev->sched->add)(dev,req);
     sti();
 }
 
+/* merge_request,
+ * 尝试将对bh的rw请求合并到设备dev已在队列中的相邻请求中,
+ * 合并成功则返回1, 否则返回0。调用者须已禁止中断。
+ *
+ * 队列头部的请求已交由驱动程序处理, 不再改变; 其余请求中若有
+ * 同一设备分区上同方向的请求, 且其扇区范围恰好在bh之前(向后合并)
+ * 或之后(向前合并), 则将bh链入该请求的缓冲区块链表中。*/
+static int merge_request(struct blk_dev_struct * dev, int rw,
+    struct buffer_head * bh)
+{
+    struct request * req;
+    unsigned long sector = bh->b_blocknr<<1;
+
+    if (!(req = dev->current_request))
+        return 0;
+    while (req = req->next) {
+        if (req->dev != bh->b_dev || req->cmd != rw || !req->bh ||
+            req->nr_sectors + 2 > MAX_SECTORS)
+            continue;
+        if (req->sector + req->nr_sectors == sector) {
+            req->bhtail->b_reqnext = bh;
+            req->bhtail = bh;
+        } else if (sector + 2 == req->sector) {
+            bh->b_reqnext = req->bh;
+            req->bh = bh;
+            req->buffer = bh->b_data;
+            req->sector = sector;
+        } else
+            continue;
+        req->nr_sectors += 2;
+        if (rw == WRITE)
+            bh->b_dirt = 0;
+        return 1;
+    }
+    return 0;
+}
+
 /* make_request,
  * 用描述各类请求的结构体数组元素request管理major对应块设备的读写请求。
  * 即将bh中携带的块设备读写信息拷贝到request元素中,好专门管理。
@@ -158,6 +172,7 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
  * 读写请求;rw=欲读或预写时,遇到需睡眠等待的情形则放弃本次请求。*/
 static void make_request(int major,int rw, struct buffer_head * bh)
 {
+    struct blk_dev_struct * bdev;
     struct request * req;
     int rw_ahead;
 
@@ -184,35 +199,46 @@ static void make_request(int major,int rw, struct buffer_head * bh)
         unlock_buffer(bh);
         return;
     }
+    /* 若能并入设备队列中的相邻请求则不再另占请求项 */
+    bh->b_reqnext = NULL;
+    bdev = major + blk_dev;
 repeat:
+    cli();
+    if (merge_request(bdev,rw,bh)) {
+        sti();
+        blk_trace(BT_MERGE,bh->b_dev,rw,bh->b_blocknr<<1,2);
+        return;
+    }
 /* we don't allow the write-requests to fill up the queue completely:
  * we want some room for reads: they take precedence. The last third
  * of the requests are only for reads.
  */
-/* 对于设备读写请求的设计是,读请求的优先级会更高一些,全局数组requests
- * 最后三分之一专用于读请求,剩余三分之二用于读写请求。*/
-    if (rw == READ)
-        req = request+NR_REQUEST;
-    else
-        req = request+((NR_REQUEST*2)/3);
-/* find an empty request */
-    while (--req >= request)
-        if (req->dev<0)
-            break;
+/* 对于设备读写请求的设计是,读请求的优先级会更高一些,设备请求项池的
+ * 最后三分之一专用于读请求,剩余三分之二用于读写请求。
+ * 从设备的空闲请求项链表头部取请求项, 无需遍历。*/
+    if ((rw == WRITE && bdev->nr_writes >= (bdev->nr_requests*2)/3) ||
+        !(req = bdev->free_request)) {
 /* if none found, sleep on new requests: check for rw_ahead */
-    /* 如果管理设备读写请求的数组中已无空闲元素时,若是预读则
-     * 直接返回,否则睡眠等待直到有某个元素被释放时重新遍历。*/
-    if (req < request) {
+    /* 如果该设备已无可用的请求项, 若是预读则直接返回,
+     * 否则睡眠等待直到该设备有请求项被释放时重试。*/
         if (rw_ahead) {
+            sti();
             unlock_buffer(bh);
             return;
         }
-        sleep_on(&wait_for_request);
+        bdev->nr_congested++;
+        sleep_on_exclusive(&bdev->wait_for_request);
+        sti();
         goto repeat;
     }
+    bdev->free_request = req->next;
+    bdev->nr_free--;
+    if (rw == WRITE)
+        bdev->nr_writes++;
+    sti();
 /* fill up the request-info, and add it to the queue */
-/* 在遍历到请求全局数组元素后,从bh所指管理缓冲区块的节点
- * 中将请求设备的详细信息拷贝到所遍历到的请求数组元素中,
+/* 在取得空闲请求项后,从bh所指管理缓冲区块的节点
+ * 中将请求设备的详细信息拷贝到所取得的请求项中,
  * 以完成缓冲区块节点结构体向请求结构体类型的过渡。*/
     req->dev = bh->b_dev;
     req->cmd = rw;
@@ -222,7 +248,9 @@ repeat:
     req->buffer = bh->b_data;
     req->waiting = NULL;
     req->bh = bh;
+    req->bhtail = bh;
     req->next = NULL;
+    req->start_time = blk_clock();
     add_request(major+blk_dev,req);
 }
 
@@ -243,20 +271,88 @@ void ll_rw_block(int rw, struct buffer_head * bh)
         printk("Trying to read nonexistent block-device\n\r");
         return;
     }
+    /* 直接指向虚拟硬盘内存的缓冲区块本身就是设备上的数据 */
+    if (bh->b_mapped) {
+        bh->b_dirt = 0;
+        bh->b_uptodate = 1;
+        return;
+    }
     
     /* 请求读写块设备,主设备号major用于映射其对应的读写函数 */
     make_request(major,rw,bh);
 }
 
+/* plug_device,
+ * 堵塞设备dev所在块设备的请求队列。
+ *
+ * 若该块设备空闲, 则在其队列头部放置一个伪请求, 使随后的请求只入
+ * 队(可相互合并)而不启动设备, 直到unplug_device。堵塞期间只可提交
+ * READA/WRITEA这类不会睡眠的请求, 否则进程可能睡眠等待永远不会被
+ * 处理的请求。*/
+void plug_device(int dev)
+{
+    unsigned int major = MAJOR(dev);
+    struct request * plug;
+
+    if (major >= NR_BLK_DEV || !blk_dev[major].request_fn)
+        return;
+    plug = plug_request + major;
+    cli();
+    if (!blk_dev[major].current_request) {
+        plug->dev = -1;
+        plug->cmd = READ;
+        plug->sector = 0;
+        plug->bh = NULL;
+        plug->next = NULL;
+        blk_dev[major].current_request = plug;
+    }
+    sti();
+}
+
+/* unplug_device,
+ * 移除plug_device放置的伪请求, 并开始处理已入队的请求。*/
+void unplug_device(int dev)
+{
+    unsigned int major = MAJOR(dev);
+    struct blk_dev_struct * bdev;
+
+    if (major >= NR_BLK_DEV)
+        return;
+    bdev = blk_dev + major;
+    cli();
+    if (bdev->current_request != plug_request + major) {
+        sti();
+        return;
+    }
+    if (bdev->current_request = plug_request[major].next)
+        bdev->current_request->dispatch_time = blk_clock();
+    sti();
+    if (bdev->current_request)
+        (bdev->request_fn)();
+}
+
 /* blk_dev_init,
- * 初始化管理块设备读写请求的全局数组。*/
-void blk_dev_init(void)
+ * 按内存大小mem_size为各块设备分配请求项池, 并初始化其空闲请求项链表。*/
+void blk_dev_init(long mem_size)
 {
-    int i;
+    struct request * req;
+    int i, n;
 
-    for (i=0 ; i<NR_REQUEST ; i++) {
-        request[i].dev = -1;
-        request[i].next = NULL;
+    for (i=0 ; i<NR_BLK_DEV ; i++) {
+        if (!(n = nr_requests[i]))
+            continue;
+        if (mem_size > 8*1024*1024)
+            n <<= 1;
+        if (n > PAGE_SIZE/sizeof(struct request))
+            n = PAGE_SIZE/sizeof(struct request);
+        if (!(req = (struct request *) get_free_page()))
+            panic("blk_dev_init: out of memory");
+        blk_dev[i].nr_requests = blk_dev[i].nr_free = n;
+        while (n-- > 0) {
+            req->dev = -1;
+            req->next = blk_dev[i].free_request;
+            blk_dev[i].free_request = req++;
+        }
     }
 }
 /* 粗略总结块设备请求管理。
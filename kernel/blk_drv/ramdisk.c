@@ -21,6 +21,18 @@
 char *rd_start;
 int rd_length = 0;
 
+/* rd_map,
+ * 返回虚拟硬盘设备dev上逻辑块block在虚拟硬盘内存段中的地址, 不在
+ * 虚拟硬盘中时返回NULL。getblk以此让虚拟硬盘的缓冲区块直接指向虚拟
+ * 硬盘内存, 读写虚拟硬盘时不再经由请求队列在两份数据之间拷贝。*/
+char * rd_map(int dev, int block)
+{
+    if (MINOR(dev) != 1 || block < 0 ||
+        (block + 1) << BLOCK_SIZE_BITS > rd_length)
+        return NULL;
+    return rd_start + (block << BLOCK_SIZE_BITS);
+}
+
 /* do_rd_request,
  * 虚拟硬盘读写请求函数。*/
 void do_rd_request(void)
@@ -31,9 +43,14 @@ void do_rd_request(void)
     /* 检查当前请求是否合理 */
     INIT_REQUEST;
 
-    /* 将扇区号换算为内存地址 */
+    /* 将扇区号换算为内存地址。
+     * 合并后的请求由多个不相邻的缓冲区块构成,
+     * 所以每次只拷贝一个缓冲区块(2扇区)。
+     * 经getblk得到的虚拟硬盘缓冲区块直接指向虚拟硬盘内存, 不会来到
+     * 这里; 虚拟硬盘上的文件也不经页缓存(见PAGE_CACHED), 只有分配
+     * 不到映射缓冲区块时退回的普通缓冲区块才需要拷贝。*/
     addr = rd_start + (CURRENT->sector << 9);
-    len = CURRENT->nr_sectors << 9;
+    len = BLOCK_SIZE;
     /* 检查次设备号和所读内存地址,若不在范围内则结束本次请求并调度下一个请求 */
     if ((MINOR(CURRENT->dev) != 1) || (addr+len > rd_start+rd_length)) {
         end_request(0);
@@ -53,7 +70,10 @@ void do_rd_request(void)
         panic("unknown ramdisk-command");
     
     /* 正常结束本次虚拟硬盘请求并调度虚拟硬盘下一个请求,
-     * 同时回到INIT_REQUEST中repeat处检查该请求的合理性。*/
+     * 同时回到INIT_REQUEST中repeat处检查该请求的合理性。
+     * 若请求中还有缓冲区块, 则end_request后仍处理当前请求。*/
+    CURRENT->sector += 2;
+    CURRENT->nr_sectors -= 2;
     end_request(1);
     goto repeat;
 }
@@ -76,6 +76,9 @@ rep_int:
     jmp rep_int /* 直到串口无中断方结束 */
 end:    movb $0x20,%al
     outb %al,$0x20  /* EOI,向PIC发送结束中断命令 */
+    pushl 32(%esp)  /* 被中断处的cs, 中断唤醒了实时进程时立即调度 */
+    call _preempt_intr
+    addl $4,%esp
     pop %ds
     pop %es
     popl %eax
@@ -150,17 +153,9 @@ write_char:
     cmpl $startup,%ebx    /* if (写队列数据元素 < 256) 则向前跳转标号1处 */
     ja 1f
 
-    /* ebx=*( (long *)(&tty_table[1 or 2].write_q + 12) )即
-     * 取串口写队列任务指针成员proc_list赋值给ebx。*/
-    movl proc_list(%ecx),%ebx # wake up sleeping process
-
-    /* 若任务指针值为空则向前跳转到标号1处 */
-    testl %ebx,%ebx # is there any?
-    je 1f
-
-    /* movl $0, *proc_list 即proc_list所指内存段首4字节置为0,
-     * 即将proc_list所指任务的state成员置位0-将所指任务置为就绪状态 */
-    movl $0,(%ebx)
+    /* 唤醒在串口写队列等待队列proc_list上睡眠的进程,
+     * 即wake_up(&tty_table[1 or 2].write_q.proc_list)。*/
+    call wake_up_writers # wake up sleeping process
 
     /* 将写队列数据尾的数据写往al,然后将其 */
 1:  movl tail(%ecx),%ebx
@@ -174,19 +169,29 @@ write_char:
     ret /* 将串口写队列中数据传输一个到串口让其发送出去 */
 .align 2
 write_buffer_empty:
-    /* 将串口写队列的proc_list成员赋值给ebx,
-     * 检查ebx是否为空,为空则向前跳转标号1处,
-     * 若不为空则赋值0给proc_list所指任务的state成员,
-     * 即将该任务置位可运行状态,即唤醒该任务。*/
-    movl proc_list(%ecx),%ebx # wake up sleeping process
-    testl %ebx,%ebx # is there any?
-    je 1f
-    movl $0,(%ebx)
-    
-1:  incl %edx   /* edx=0x3f9(0x2f9) */
+    /* 唤醒在串口写队列上等待的进程 */
+    call wake_up_writers # wake up sleeping process
+    incl %edx   /* edx=0x3f9(0x2f9) */
     inb %dx,%al /* 读中断允许标志寄存器 */
     jmp 1f
 1: jmp 1f
 1: andb $0xd,%al /* disable transmit interrupt */
     outb %al,%dx /* 禁止串口发送寄存器空中断,因为此时写队列中的数据已发送完毕 */
     ret
+
+/* wake_up_writers,
+ * ecx指向串口写队列, 若其等待队列proc_list不为空则调用
+ * wake_up(&proc_list)唤醒在其上等待的进程, 保留ecx和edx。*/
+.align 2
+wake_up_writers:
+    cmpl $0,proc_list(%ecx) # is there any?
+    je 1f
+    pushl %edx
+    pushl %ecx
+    leal proc_list(%ecx),%ebx
+    pushl %ebx
+    call _wake_up
+    addl $4,%esp
+    popl %ecx
+    popl %edx
+1:  ret
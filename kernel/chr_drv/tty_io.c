@@ -144,16 +144,16 @@ void tty_init(void)
 }
 
 /* tty_intr,
- * 产生mask信号给tty所在进程组的进程。*/
-void tty_intr(struct tty_struct * tty, int mask)
+ * 产生sig信号给tty所在进程组的进程。*/
+void tty_intr(struct tty_struct * tty, int sig)
 {
-    int i;
+    struct task_struct * p;
 
     if (tty->pgrp <= 0)
         return;
-    for (i=0;i<NR_TASKS;i++)
-        if (task[i] && task[i]->pgrp==tty->pgrp)
-            task[i]->signal |= mask;
+    for (p = pgrphash[pid_hashfn(tty->pgrp)] ; p ; p = p->pgrp_next)
+        if (p->pgrp==tty->pgrp)
+            post_sig(p,sig);
 }
 
 /* sleep_if_empty,
@@ -304,11 +304,11 @@ void copy_to_cooked(struct tty_struct * tty)
          * 程所在组的所有进程发送退出信号。做完这些处理后继续处理下1字符。*/
         if (L_ISIG(tty)) {
             if (c==INTR_CHAR(tty)) {
-                tty_intr(tty,INTMASK);
+                tty_intr(tty,SIGINT);
                 continue;
             }
             if (c==QUIT_CHAR(tty)) {
-                tty_intr(tty,QUITMASK);
+                tty_intr(tty,SIGQUIT);
                 continue;
             }
         }
@@ -360,7 +360,8 @@ int tty_read(unsigned channel, char * buf, int nr)
 {
     struct tty_struct * tty;
     char c, * b=buf;
-    int minimum,time,flag=0;
+    char kbuf[64];
+    int minimum,time,flag=0,n;
     long oldalarm;
 
     /* 根据channel获取 管理字符设备的结构体 */
@@ -371,16 +372,16 @@ int tty_read(unsigned channel, char * buf, int nr)
      * 获取为字符设备设置的超时值(0则未设置)和达到该超
      * 时值应读取的字符数,若当前进程没有设置超时值或者
      * 读取字符设备的超时值小于进程原设置的超时值,则用
-     * 读取字符的超时值覆盖进程原超时值。待任务调度函数
-     * 执行时(如当前进程进入睡眠后)会检查当前进程是否超
-     * 时,若超时则会给任务置超时信号。*/
+     * 读取字符的超时值覆盖进程原超时值。超时值经set_alarm
+     * 设置到进程的报警定时器中, 到时由定时器中断给进程置
+     * 超时信号。*/
     oldalarm = current->alarm;
-    time = 10L*tty->termios.c_cc[VTIME];
+    time = (long) tty->termios.c_cc[VTIME]*HZ/10; /* VTIME以0.1秒计 */
     minimum = tty->termios.c_cc[VMIN];
     if (time && !minimum) {
         minimum=1;
         if (flag=(!oldalarm || time+jiffies<oldalarm))
-            current->alarm = time+jiffies;
+            set_alarm(time+jiffies);
     }
     if (minimum>nr)
         minimum=nr;
@@ -421,18 +422,29 @@ int tty_read(unsigned channel, char * buf, int nr)
          * 在字符设备开启规范标志时,若读到文件结束
          * 符,换行符时则结束读操作;或在读满nr字符或
          * 读完辅助队列内容方结束。*/
+        /* 字符先暂存在kbuf中, 攒满或本轮读取结束时
+         * 再以memcpy_tofs一并拷贝到buf中。*/
+        n = 0;
         do {
             GETCH(tty->secondary,c);
             if (c==EOF_CHAR(tty) || c==10)
                 tty->secondary.data--;
-            if (c==EOF_CHAR(tty) && L_CANON(tty))
-                return (b-buf);
-            else {
-                put_fs_byte(c,b++);
+            if (c==EOF_CHAR(tty) && L_CANON(tty)) {
+                memcpy_tofs(b,kbuf,n);
+                return (b+n-buf);
+            } else {
+                kbuf[n++] = c;
+                if (n == sizeof(kbuf)) {
+                    memcpy_tofs(b,kbuf,n);
+                    b += n;
+                    n = 0;
+                }
                 if (!--nr)
                     break;
             }
         } while (nr>0 && !EMPTY(tty->secondary));
+        memcpy_tofs(b,kbuf,n);
+        b += n;
 
         /* 检查并更新当前进程的超时值。
          * 
@@ -442,9 +454,9 @@ int tty_read(unsigned channel, char * buf, int nr)
          * 字符设备所设置的超时值,否则恢复进程原本超时值。*/
         if (time && !L_CANON(tty))
             if (flag=(!oldalarm || time+jiffies<oldalarm))
-                current->alarm = time+jiffies;
+                set_alarm(time+jiffies);
             else
-                current->alarm = oldalarm;
+                set_alarm(oldalarm);
 
         /* 在一次读取循环结束后,
          * 在规范模式下,只要读到字符便结束本次读取;
@@ -458,7 +470,8 @@ int tty_read(unsigned channel, char * buf, int nr)
     
     /* 恢复进程的超时值,若读取超时且没有读取到任何字
      * 符则返回相应错误码,否则返回读取成功的字符数。*/
-    current->alarm = oldalarm;
+    if (current->alarm != oldalarm)
+        set_alarm(oldalarm);
     if (current->signal && !(b-buf))
         return -EINTR;
     return (b-buf);
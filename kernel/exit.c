@@ -12,6 +12,7 @@
 #include <linux/kernel.h>
 #include <linux/tty.h>
 #include <asm/segment.h>
+#include <asm/system.h>
 
 int sys_pause(void);
 int sys_close(int fd);
@@ -20,19 +21,14 @@ int sys_close(int fd);
  * 释放p所指向结构体所占内存。*/
 void release(struct task_struct * p)
 {
-    int i;
-
     if (!p)
         return;
-    /* 遍历地址为p的结构体,释放其内存并置空后进行任务调度 */
-    for (i=1 ; i<NR_TASKS ; i++)
-        if (task[i]==p) {
-            task[i]=NULL;
-            free_page((long)p);
-            schedule();
-            return;
-        }
-    panic("trying to release non-existent task");
+    if (!p->nr || task[p->nr] != p)
+        panic("trying to release non-existent task");
+    /* 将p移出各进程链表并释放其任务号和内存后进行任务调度 */
+    unlink_task(p);
+    free_page((long)p);
+    schedule();
 }
 
 /* send_sig,
@@ -45,7 +41,7 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
     /* priv置位或当前进程与目标进程有效进程id相同或当前
      * 进程为超级进程则往p指向结构体所管理进程置sig信号。*/
     if (priv || (current->euid==p->euid) || suser())
-        p->signal |= (1<<(sig-1));
+        post_sig(p,sig);
     else
         return -EPERM;
     return 0;
@@ -55,12 +51,25 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
  * 向与当前进程同会话的进程发送进程终止信号。*/
 static void kill_session(void)
 {
-    struct task_struct **p = NR_TASKS + task;
+    struct task_struct * p = sessionhash[pid_hashfn(current->session)];
 
-    while (--p > &FIRST_TASK) {
-        if (*p && (*p)->session == current->session)
-            (*p)->signal |= 1<<(SIGHUP-1);
-    }
+    for ( ; p ; p = p->session_next)
+        if (p->session == current->session)
+            post_sig(p,SIGHUP);
+}
+
+/* kill_pg,
+ * 向进程组id为pgrp的所有进程发送sig信号, priv同send_sig。*/
+static int kill_pg(long pgrp, int sig, int priv)
+{
+    struct task_struct * p = pgrphash[pid_hashfn(pgrp)];
+    int err, retval = 0;
+
+    for ( ; p ; p = p->pgrp_next)
+        if (p->pgrp == pgrp)
+            if (err=send_sig(sig,p,priv))
+                retval = err;
+    return retval;
 }
 
 /*
@@ -71,53 +80,58 @@ static void kill_session(void)
  */
 int sys_kill(int pid,int sig)
 {
-    struct task_struct **p = NR_TASKS + task;
+    struct task_struct * p;
     int err, retval = 0;
 
     /* 当pid=0时,则向所有进程组id为当前进程id的进程发送sig信号 */
-    if (!pid) while (--p > &FIRST_TASK) {
-        if (*p && (*p)->pgrp == current->pid) 
-            if (err=send_sig(sig,*p,1))
-                retval = err;
+    if (!pid)
+        return kill_pg(current->pid,sig,1);
     /* 若当前进程有足够权限(超级进程或与目标进程有效用户id相同)
      * 则向进程id为pid的进程发送sig信号 */
-    } else if (pid>0) while (--p > &FIRST_TASK) {
-        if (*p && (*p)->pid == pid) 
-            if (err=send_sig(sig,*p,0))
-                retval = err;
+    if (pid>0)
+        return (p = find_task_by_pid(pid)) ? send_sig(sig,p,0) : 0;
     /* 若pid为-1,则向所有进程尝试发送sig信号 */
-    } else if (pid == -1) while (--p > &FIRST_TASK)
-        if (err = send_sig(sig,*p,0))
-            retval = err;
-    /* 若pid小于-1,则将pid取反后当pid大于0情况处理 */
-    else while (--p > &FIRST_TASK)
-        if (*p && (*p)->pgrp == -pid)
-            if (err = send_sig(sig,*p,0))
+    if (pid == -1) {
+        for_each_task(p)
+            if (err = send_sig(sig,p,0))
                 retval = err;
-    return retval;
+        return retval;
+    }
+    /* 若pid小于-1,则向进程组id为-pid的进程发送sig信号 */
+    return kill_pg(-pid,sig,0);
 }
 
 /* tell_father,
- * 向父进程(pid)发送当前进程已停止的信号。*/
-static void tell_father(int pid)
+ * 向父进程发送当前进程已停止的信号。
+ * 进程退出时其子进程都被转给init进程, 所以父进程总是存在。*/
+static void tell_father(void)
 {
-    int i;
+    post_sig(current->p_pptr,SIGCHLD);
+}
 
-    if (pid)
-        for (i=0;i<NR_TASKS;i++) {
-            if (!task[i])
-                continue;
-        if (task[i]->pid != pid)
-            continue;
-        task[i]->signal |= (1<<(SIGCHLD-1));
-        return;
+/* forget_original_parent,
+ * 将当前进程的子进程转给init进程(task[1]), 若其中有僵尸进程则向init
+ * 进程发送SIGCHLD信号让其回收管理这些进程的结构体, 见sys_waitpid。*/
+static void forget_original_parent(void)
+{
+    struct task_struct * p, * init = task[1];
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    while ((p = current->p_cptr)) {
+        current->p_cptr = p->p_osptr;
+        p->father = 1;
+        p->p_pptr = init;
+        p->p_ysptr = NULL;
+        if ((p->p_osptr = init->p_cptr))
+            p->p_osptr->p_ysptr = p;
+        init->p_cptr = p;
+        if (p->state == TASK_ZOMBIE)
+            /* assumption task[1] is always init */
+            (void) send_sig(SIGCHLD, init, 1);
     }
-/* if we don't find any fathers, we just release ourselves */
-/* This is not really OK. Must change it to make father 1 */
-/* 若当前进程没有父进程,则自我释放管理当前进程的结构体,不提倡自我释放管理当前
- * 进程的结构体,在没有找到父进程时应该do_exit中将其父进程id设置为1(init进程)。*/
-    printk("BAD BAD - no father found\n\r");
-    release(current);
+    restore_flags(flags);
 }
 
 /* do_exit,
@@ -130,15 +144,8 @@ int do_exit(long code)
     free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
     free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
 
-    /* 标记当前进程子进程的父进程id为1,若其子进程为僵尸进程则向init进程发送
-     * SIGCHLD信号让init进程回收下管理当前进程子进程的结构体资源,见sys_waitpid。*/
-    for (i=0 ; i<NR_TASKS ; i++)
-        if (task[i] && task[i]->father == current->pid) {
-            task[i]->father = 1;
-            if (task[i]->state == TASK_ZOMBIE)
-                /* assumption task[1] is always init */
-                (void) send_sig(SIGCHLD, task[1], 1);
-        }
+    /* 将当前进程的子进程转给init进程 */
+    forget_original_parent();
 
     /* 关闭当前进程所打开的文件 */
     for (i=0 ; i<NR_OPEN ; i++)
@@ -159,6 +166,8 @@ int do_exit(long code)
         tty_table[current->tty].pgrp = 0;
     if (last_task_used_math == current)
         last_task_used_math = NULL;
+    /* 取消报警定时器, 以免在进程结构体被释放后到期 */
+    del_timer(&current->alarm_timer);
 
     /* 若当前进程为会话首领,则终止该会话下的所有进程 */
     if (current->leader)
@@ -170,7 +179,7 @@ int do_exit(long code)
     current->exit_code = code;
 
     /* 向父进程发送信号告知本进程已停止运行 */
-    tell_father(current->father);
+    tell_father();
     
     /* 调度时间片最大的进程运行 */
     schedule();
@@ -198,50 +207,44 @@ int sys_exit(int error_code)
 int sys_waitpid(pid_t pid,unsigned long * stat_addr, int options)
 {
     int flag, code;
-    struct task_struct ** p;
+    struct task_struct * p;
 
     /* 写时拷贝当前进程数据段中的stat_addr */
     verify_area(stat_addr,4);
     
 repeat:
     flag=0;
-    for(p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-        /* 遍历系统当前进程管理结构体, */
+    for (p = current->p_cptr ; p ; p = p->p_osptr) {
+        /* 遍历本进程的子进程 */
 
-        /* 跳过本进程及无关联进程的结构体元素 */
-        if (!*p || *p == current)
-            continue;
-        /* 忽略父进程不为本进程的进程 */
-        if ((*p)->father != current->pid)
-            continue;
         /* pid>0时表等待指定的子进程id */
         if (pid>0) {
-            if ((*p)->pid != pid)
+            if (p->pid != pid)
                 continue;
         /* pid=0时表等待与本进程组id相同的子进程 */
         } else if (!pid) {
-            if ((*p)->pgrp != current->pgrp)
+            if (p->pgrp != current->pgrp)
                 continue;
         /* pid < -1时表等待组id为|pid|的子进程 */
         } else if (pid != -1) {
-            if ((*p)->pgrp != -pid)
+            if (p->pgrp != -pid)
                 continue;
         }
         /* pid=-1则表明等待任意的子进程结束 */
-        switch ((*p)->state) {
+        switch (p->state) {
             case TASK_STOPPED: /* 进程已停止 */
                 /* 若不获取已停止进程状态则继续遍历 */
                 if (!(options & WUNTRACED))
                     continue;
                 /* 对于已停止进程,退出码为0x7f */
                 put_fs_long(0x7f,stat_addr);
-                return (*p)->pid; /* 返回子进程id */
+                return p->pid; /* 返回子进程id */
             case TASK_ZOMBIE: /* 僵尸进程 */
-                current->cutime += (*p)->utime;
-                current->cstime += (*p)->stime;
-                flag = (*p)->pid;
-                code = (*p)->exit_code;
-                release(*p); /* 回收僵尸进程资源 */
+                current->cutime += p->utime;
+                current->cstime += p->stime;
+                flag = p->pid;
+                code = p->exit_code;
+                release(p); /* 回收僵尸进程资源 */
                 /* 返回进程运行结束退出码和进程id */
                 put_fs_long(code,stat_addr);
                 return flag;
@@ -21,10 +21,146 @@
 #include <asm/system.h>
 
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);
 
 /* 用于保存新建进程id号 */
 long last_pid=0;
 
+/* 按进程id, 进程组id和会话id散列的进程链表, 进程在fork时加入,
+ * 在被release时移除(僵尸进程仍在其中)。任务0不在其中。*/
+struct task_struct * pidhash[PIDHASH_SZ];
+struct task_struct * pgrphash[PIDHASH_SZ];
+struct task_struct * sessionhash[PIDHASH_SZ];
+
+/* hash_add,hash_del,
+ * 将p加入以*head为表头的散列链表, 或从其所在散列链表中移除,
+ * next和pprev为p中相应链表的链接成员。须在关中断下调用, 因为
+ * 中断处理(如tty_intr)也会遍历这些链表。*/
+#define hash_add(head,p,next,pprev) do { \
+    if (((p)->next = *(head))) \
+        (*(head))->pprev = &(p)->next; \
+    *(head) = (p); \
+    (p)->pprev = (head); \
+} while (0)
+
+#define hash_del(p,next,pprev) do { \
+    if ((p)->next) \
+        (p)->next->pprev = (p)->pprev; \
+    *(p)->pprev = (p)->next; \
+} while (0)
+
+/* 空闲任务号: 释放的任务号压入free_nr, 分配时先从中取, 取完后再用
+ * 从未用过的任务号next_nr, 分配和释放都是常数时间。*/
+static int free_nr[NR_TASKS];
+static int nr_free = 0;
+static int next_nr = 1;
+
+/* get_task_nr,
+ * 分配一个空闲任务号, 无空闲任务号时返回-EAGAIN。*/
+static int get_task_nr(void)
+{
+    if (nr_free)
+        return free_nr[--nr_free];
+    if (next_nr < NR_TASKS)
+        return next_nr++;
+    return -EAGAIN;
+}
+
+/* put_task_nr,
+ * 释放任务号nr。*/
+static void put_task_nr(int nr)
+{
+    task[nr] = NULL;
+    free_nr[nr_free++] = nr;
+}
+
+/* find_task_by_pid,
+ * 返回进程id为pid的进程, 不存在时返回NULL。*/
+struct task_struct * find_task_by_pid(long pid)
+{
+    struct task_struct * p;
+
+    for (p = pidhash[pid_hashfn(pid)] ; p ; p = p->pidhash_next)
+        if (p->pid == pid)
+            return p;
+    return NULL;
+}
+
+/* set_pgrp,
+ * 将进程p的进程组id改为pgrp, 并将其移到相应的散列链表中。*/
+void set_pgrp(struct task_struct * p, long pgrp)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    hash_del(p,pgrp_next,pgrp_pprev);
+    p->pgrp = pgrp;
+    hash_add(pgrphash+pid_hashfn(pgrp),p,pgrp_next,pgrp_pprev);
+    restore_flags(flags);
+}
+
+/* set_session,
+ * 将进程p的会话id改为session, 并将其移到相应的散列链表中。*/
+void set_session(struct task_struct * p, long session)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    hash_del(p,session_next,session_pprev);
+    p->session = session;
+    hash_add(sessionhash+pid_hashfn(session),p,session_next,session_pprev);
+    restore_flags(flags);
+}
+
+/* link_task,
+ * 将新建进程p加入进程链表, 各散列链表, 及其父进程(当前进程)的子进程
+ * 链表(作为最年轻的子进程)。*/
+static void link_task(struct task_struct * p)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    p->next_task = task[0];
+    p->prev_task = task[0]->prev_task;
+    task[0]->prev_task->next_task = p;
+    task[0]->prev_task = p;
+    hash_add(pidhash+pid_hashfn(p->pid),p,pidhash_next,pidhash_pprev);
+    hash_add(pgrphash+pid_hashfn(p->pgrp),p,pgrp_next,pgrp_pprev);
+    hash_add(sessionhash+pid_hashfn(p->session),p,session_next,session_pprev);
+    p->p_pptr = current;
+    p->p_cptr = p->p_ysptr = NULL;
+    if ((p->p_osptr = current->p_cptr))
+        p->p_osptr->p_ysptr = p;
+    current->p_cptr = p;
+    restore_flags(flags);
+}
+
+/* unlink_task,
+ * 将进程p从link_task所加入的各链表中移除并释放其任务号。*/
+void unlink_task(struct task_struct * p)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    p->next_task->prev_task = p->prev_task;
+    p->prev_task->next_task = p->next_task;
+    hash_del(p,pidhash_next,pidhash_pprev);
+    hash_del(p,pgrp_next,pgrp_pprev);
+    hash_del(p,session_next,session_pprev);
+    if (p->p_osptr)
+        p->p_osptr->p_ysptr = p->p_ysptr;
+    if (p->p_ysptr)
+        p->p_ysptr->p_osptr = p->p_osptr;
+    else
+        p->p_pptr->p_cptr = p->p_osptr;
+    put_task_nr(p->nr);
+    restore_flags(flags);
+}
+
 /* verify_area,
  * 基于当前进程数据段基址dbase,以4Kb将内存段
  * [dbase + addr, dbase + addr + size)对齐。
@@ -83,10 +219,10 @@ int copy_mem(int nr,struct task_struct * p)
     if (data_limit < code_limit)
         panic("Bad data_limit");
 
-    /* 进程逻辑地址空间为[nr * 0x4000000, (nr+1) * 0x4000000 - 1]每个
-     * 进程的逻辑地址空间为64Mb,64进程逻辑空间共64 * 0x4000000 = 4Gb。
+    /* 进程逻辑地址空间为[nr * TASK_SIZE, (nr+1) * TASK_SIZE - 1], NR_TASKS
+     * 个进程的逻辑地址空间共NR_TASKS * TASK_SIZE = 4Gb。
      * 将进程代码段和数据段逻辑基址设置到其LDT中。*/
-    new_data_base = new_code_base = nr * 0x4000000;
+    new_data_base = new_code_base = nr * TASK_SIZE;
     p->start_code = new_code_base;
     set_base(p->ldt[1],new_code_base);
     set_base(p->ldt[2],new_data_base);
@@ -139,11 +275,14 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     struct task_struct *p;
     int i;
     struct file *f;
+    long * stack;
 
     /* 为管理进程结构体分配内存 */
     p = (struct task_struct *) get_free_page();
-    if (!p)
+    if (!p) {
+        put_task_nr(nr);
         return -EAGAIN;
+    }
     task[nr] = p;
 
     /* 将管理父进程(当前进程)的结构体复制到管理子进程
@@ -155,53 +294,56 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     p->counter = p->priority; /* 进程初始时间片为其优先级时间片 */
     p->signal = 0; /* 无处理信号 */
     p->alarm = 0;  /* 无报警超时 */
+    init_timer(&p->alarm_timer);
     p->leader = 0; /* process leadership doesn't inherit */
     p->utime = p->stime = 0;   /* 进程运行时间 */
     p->cutime = p->cstime = 0; /* 其子进程运行时间 */
     p->start_time = jiffies;   /* 进程诞生时间(片) */
-    p->tss.back_link = 0;      /* 上一个进程TSS选择符 */
-    p->tss.esp0 = PAGE_SIZE + (long) p; /* 子进程内核态下的栈顶, 见struct union task */
-    p->tss.ss0 = 0x10; /* 子进程内核态栈段 */
-    /* 回看栈中内容吧: eip=fork函数中"if (__res >= 0)"处偏移地址;
-     * fork函数中有提到, 父进程通过"int 80h"指令完成系统调用后将
-     * 执行"if (__res >= 0)"处及后续语句;此处亦将"if (__res >= 0)"
-     * 语句处偏移地址赋给子进程TSS.eip,当子进程被调度运行时也会执
-     * "if (__res >= 0)"处及后续语句,所以fork函数会在父子进程中各
-     * 返回1次。
+    p->nr = nr;                /* 任务号 */
+    p->run_next = p->run_prev = NULL; /* 尚不在运行队列中 */
+    p->epoch = sched_epoch;    /* 时间片在本轮计算 */
+    p->run_delay = p->pcount = p->nvcsw = p->nivcsw = 0; /* 调度统计 */
+    p->last_run = jiffies;
+    /* 在子进程内核栈中构造其首次被switch_to切换运行时的栈帧: 自下而上
+     * 依次为父进程执行"int 80h"时CPU压入的ss,esp,eflags,cs,eip, 与
+     * _system_call相同排列的ds,es,fs,edx,ecx,ebx,eax, 以及esi,edi,ebp
+     * 和switch_to要弹出的fs,gs, 栈顶为返回地址ret_from_fork。
+     *
+     * 子进程被调度运行时, switch_to中的ret将跳转到ret_from_fork, 由其
+     * 弹出各寄存器后经ret_from_sys_call返回用户态, 即从父进程fork函数中
+     * "if (__res >= 0)"处继续执行, 所以fork会在父子进程中各返回1次。
      *
      * 另外,为了不让RET语句破坏子进程正确的栈内容,fork函数需为内联
      * 函数(内联函数指令被直接嵌在被调用处,无CALL-RET对栈暗中操作)。*/
-    p->tss.eip = eip;
-    /* 使用栈中备份的标志寄存器,真实标志寄存器TF&&IF位已置0 */
-    p->tss.eflags = eflags;
-    /* 当调度子进程运行时, eax=TSS.eax,
-     * eax将作为"fork返回值":__res=eax,
-     * 这也是fork在子进程中返回0的原因。*/
-    p->tss.eax = 0;
-    /* 子进程各寄存器继承父进程调fork之前各寄存器值 */
-    p->tss.ecx = ecx;
-    p->tss.edx = edx;
-    p->tss.ebx = ebx;
-    p->tss.esp = esp;
-    p->tss.ebp = ebp;
-    p->tss.esi = esi;
-    p->tss.edi = edi;
-    p->tss.es = es & 0xffff;
-    p->tss.cs = cs & 0xffff;
-    p->tss.ss = ss & 0xffff;
-    p->tss.ds = ds & 0xffff;
-    p->tss.fs = fs & 0xffff;
-    p->tss.gs = gs & 0xffff;
-    p->tss.ldt = _LDT(nr); /* 将本进程LDT选择符赋予TSS.ldt字段 */
-    p->tss.trace_bitmap = 0x80000000; /* I/O许可位图偏移 */
+    stack = (long *) (PAGE_SIZE + (long) p);
+    *--stack = ss & 0xffff;
+    *--stack = esp;
+    *--stack = eflags;
+    *--stack = cs & 0xffff;
+    *--stack = eip;
+    *--stack = ds & 0xffff;
+    *--stack = es & 0xffff;
+    *--stack = fs & 0xffff;
+    *--stack = edx;
+    *--stack = ecx;
+    *--stack = ebx;
+    /* 子进程中eax即fork返回值为0 */
+    *--stack = 0;
+    *--stack = esi;
+    *--stack = edi;
+    *--stack = ebp;
+    *--stack = fs & 0xffff;
+    *--stack = gs & 0xffff;
+    *--stack = (long) ret_from_fork;
+    p->kesp = (long) stack;
     /* 若父进程使用了协处理器,则清CR0TS标志并将协处理器转态备份 */
     if (last_task_used_math == current)
         __asm__("clts ; fnsave %0"::"m" (p->tss.i387));
 
-    /* 通过页机制将[nr * 0x4000000, (nr + 1) * 0x4000000)内存地址空间映
-     * 射父进程数据和代码内存段,并将基址nr*0x4000000设置在子进程的LDT中。*/
+    /* 通过页机制将[nr * TASK_SIZE, (nr + 1) * TASK_SIZE)内存地址空间映
+     * 射父进程数据和代码内存段,并将基址nr*TASK_SIZE设置在子进程的LDT中。*/
     if (copy_mem(nr,p)) {
-        task[nr] = NULL;
+        put_task_nr(nr);
         free_page((long) p);
         return -EAGAIN;
     }
@@ -218,16 +360,12 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     if (current->executable)
         current->executable->i_count++;
     
-    /* 在GDT中为新建进程设置TSS和LDT,可以再结合schedule
-     * 函数粗略理解进程切换过程: _TSS(nr)将得到task[nr]
-     * 进程TSS的选择符, 使用ljmp指令跳转GDT[_TSS(nr)]时
-     * CPU会将_TSS(nr)加载到TR并由此访问到进程TSS即获取
-     * 到进程运行上下文;随后将进程LDT选择符GDT[TSS.ldt]
-     * 加载到LDTR并访问进程LDT,即由此访问到由LDT所描述代
-     * 码和数据内存段,由此运行task[nr]所管理的进程。*/
-    set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
-    set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
-    p->state = TASK_RUNNING; /* do this last, just in case */
+    /* 在GDT中为新建进程设置LDT, 进程切换时switch_to将_LDT(nr)加载到
+     * LDTR, 由此访问到由LDT所描述的代码和数据内存段。所有进程共用任务
+     * 0的TSS, 不再为新进程设置TSS描述符。*/
+    set_ldt_desc(gdt+nr+FIRST_LDT_ENTRY,&(p->ldt));
+    link_task(p);
+    wake_up_process(p); /* do this last, just in case */
     
     /* 再继续跟踪下fork函数的返回流程吧,直到main调用fork处。
      * --> _sys_fork --> _system_call --> fork
@@ -239,19 +377,13 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 
 /* find_empty_process,
  * 为新进程编译唯一进程id和空闲未用进程结构体。
- * 该函数由_sys_fork调用。*/
+ * 该函数由_sys_fork调用, 所返回的任务号由copy_process使用或释放。*/
 int find_empty_process(void)
 {
-    int i;
-
     /* 全局变量last_pid用于记录新进程id */
     repeat:
         if ((++last_pid)<0) last_pid=1;
-        for(i=0 ; i<NR_TASKS ; i++)
-            if (task[i] && task[i]->pid == last_pid) goto repeat;
-    /* 在进程管理结构体中遍历空闲元素并返回空闲元素下标 */
-    for(i=1 ; i<NR_TASKS ; i++)
-        if (!task[i])
-            return i;
-    return -EAGAIN;
+        if (find_task_by_pid(last_pid)) goto repeat;
+    /* 分配空闲任务号作为task数组下标 */
+    return get_task_nr();
 }
@@ -60,5 +60,5 @@ void math_error(void)
 
     /* 向正使用协处理器的进程发送协处理器出错信号 */
     if (last_task_used_math)
-        last_task_used_math->signal |= 1<<(SIGFPE-1);
+        post_sig(last_task_used_math,SIGFPE);
 }
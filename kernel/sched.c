@@ -14,6 +14,8 @@
  * 和一些简单的系统调用函数(如 getpid()),这些系统调用差不多仅从管理进程结构体中获取某
  * 成员状态并返回。*/
 
+#include <errno.h>
+
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/sys.h>
@@ -21,6 +23,7 @@
 #include <asm/system.h>
 #include <asm/io.h>
 #include <asm/segment.h>
+#include <sys/schedstat.h>
 
 #include <signal.h>
 
@@ -43,21 +46,47 @@ void show_task(int nr,struct task_struct * p)
     while (i<j && !((char *)(p+1))[i])
         i++;
     printk("%d (of %d) chars free in kernel stack\n\r",i,j);
+
+    /* 调度统计 */
+    printk("    utime=%u stime=%u run %u times, waited %u ticks, "
+        "vcsw=%u ivcsw=%u, last ran %u ticks ago\n\r",
+        p->utime,p->stime,p->pcount,p->run_delay,
+        p->nvcsw,p->nivcsw,jiffies-p->last_run);
 }
 
+/* 唤醒延迟直方图: 进程从被唤醒到被调度运行的时间,
+ * 第i个桶统计[2^i, 2^(i+1))微秒(第0个桶还包括不足1微秒的)。*/
+static unsigned long sched_latency[SCHEDSTAT_BUCKETS];
+
 /* show_stat,
- * 打印当前所有进程的运行状态,内核栈空闲字节数。*/
+ * 打印当前所有进程的运行状态,内核栈空闲字节数,
+ * 以及唤醒延迟直方图中的非空桶。*/
 void show_stat(void)
 {
+    struct task_struct * p;
     int i;
 
-    for (i=0;i<NR_TASKS;i++)
-        if (task[i])
-            show_task(i,task[i]);
+    show_task(0,task[0]);
+    for_each_task(p)
+        show_task(p->nr,p);
+    printk("wakeup latency:");
+    for (i=0 ; i<SCHEDSTAT_BUCKETS ; i++)
+        if (sched_latency[i])
+            printk(" %uus:%u",1UL<<i,sched_latency[i]);
+    printk("\n\r");
 }
 
-/* 1193180Hz为定时器工作频率 */
-#define LATCH (1193180/HZ)
+/* log2_bucket,
+ * 返回延迟t(微秒)所在的直方图桶号。*/
+static inline int log2_bucket(unsigned long t)
+{
+    int i;
+
+    if (!t)
+        return 0;
+    __asm__("bsrl %1,%0":"=r" (i):"r" (t));
+    return i;
+}
 
 extern void mem_use(void);
 
@@ -84,8 +113,8 @@ union task_union {
  * 用INIT_TASK初始化 管理初始进程的结构体后,各成员初始状态为
  * union task_union init_task = {
  *     .state      = 0,       // 置进程为可运行状态
- *     .counter    = 15,      // 进程运行时间片为15(150ms)
- *     .priority   = 15,      // 进程(在时间片上的)优先级为15
+ *     .counter    = DEF_PRIORITY, // 进程运行时间片为150ms
+ *     .priority   = DEF_PRIORITY, // 进程(在时间片上的)优先级
  *     .signal     = 0,       // 进程当前无任何需处理的信号
  *     .sigaction  = {{},},   // 处理信号的回调函数为NULL
  *     .blocked    = 0,       // 无屏蔽信号位
@@ -161,7 +190,8 @@ union task_union {
 static union task_union init_task = {INIT_TASK,};
 
 /* jiffies用于记录系统开机所运行的时间片。jiffies在定时器中断处理函数
- * 中会被增1,定时器中断约每10ms发生一次,即jiffies * 10ms即为开机时常。*/
+ * 中会被增1,定时器中断每1/HZ秒发生一次,即jiffies/HZ即为开机时长(秒)。
+ * 空闲时滴答可能被停止, 停止期间的滴答在恢复时一并补上(见tick_resume)。*/
 long volatile jiffies=0;
 
 /* 用于记录系统开机时间(见main.c/time_init) */
@@ -174,7 +204,7 @@ struct task_struct *last_task_used_math = NULL;
 
 /* 指向进程管理结构体的全局指针数组。
  * task[0] = &init_task.task即指向管理初始进程的结构体。
- * linux0.11最多能支持64个进程的管理(NR_TASKS=64)。
+ * 最多能支持NR_TASKS个进程, 空闲的任务号见fork.c中的get_task_nr。
  * task数组的下标充当了任务号,比如初始任务的任务号为0,依次类推。*/
 struct task_struct * task[NR_TASKS] = {&(init_task.task), };
 
@@ -215,6 +245,208 @@ void math_state_restore()
     }
 }
 
+/* 运行队列的优先级级数, 须不小于MAX_RT_PRIO */
+#define NR_PRIO 128
+
+/* struct prio_array,
+ * 运行队列。普通进程以其剩余时间片数counter(按HZ为100折算)为优先级
+ * (大于NR_PRIO-1者按NR_PRIO-1算), 实时进程以其静态优先级rt_priority为
+ * 优先级(见task_prio), queue[i]为优先级i的进程循环链表(先进先出),
+ * bitmap第i位置位表示queue[i]非空, 由此可在常数时间内找到优先级最
+ * 高的进程。对普通进程, 这与原先遍历task[]选出counter最大者的结果一致。
+ *
+ * 当前进程和任务0不在运行队列中: 当前进程在schedule中被切换出去时
+ * 若仍可运行才重新入队, 任务0在无其他可运行进程时运行。*/
+struct prio_array {
+    int nr_active;
+    unsigned long bitmap[NR_PRIO/32];
+    struct task_struct * queue[NR_PRIO];
+};
+
+/* active,  时间片未用完的可运行进程;
+ * expired, 时间片已用完(已按优先级重新计算时间片)的可运行进程。
+ * active为空时两者互换并将调度轮次sched_epoch增1, 这相当于原先在
+ * 所有可运行进程时间片为0时为所有进程重新计算时间片。*/
+static struct prio_array prio_arrays[2];
+static struct prio_array * active = prio_arrays;
+static struct prio_array * expired = prio_arrays + 1;
+long sched_epoch = 0;
+
+/* rt_array, 可运行的实时进程, 总是先于active中的普通进程运行 */
+static struct prio_array rt_array;
+
+/* need_resched, 置位时在中断或系统调用返回用户态前调度, 在唤醒了优先
+ * 级比当前进程高的实时进程或当前进程时间片用完时置位, 由schedule清除。*/
+int need_resched = 0;
+
+/* task_prio,
+ * 返回进程p在运行队列中的优先级。*/
+static inline int task_prio(struct task_struct * p)
+{
+    int prio;
+
+    if (rt_task(p))
+        return p->rt_priority;
+    prio = p->counter * 100 / HZ;
+    return prio > NR_PRIO-1 ? NR_PRIO-1 : prio;
+}
+
+/* prio_add,
+ * 将进程p加入运行队列array中与其优先级对应的链表尾部。*/
+static void prio_add(struct prio_array * array, struct task_struct * p)
+{
+    int prio = task_prio(p);
+    struct task_struct ** head;
+
+    head = array->queue + prio;
+
+    if (!*head) {
+        *head = p->run_next = p->run_prev = p;
+        array->bitmap[prio>>5] |= 1UL << (prio & 31);
+    } else {
+        p->run_next = *head;
+        p->run_prev = (*head)->run_prev;
+        (*head)->run_prev->run_next = p;
+        (*head)->run_prev = p;
+    }
+    p->run_array = array;
+    array->nr_active++;
+}
+
+/* prio_del,
+ * 将进程p从其所在的运行队列中移除, p的优先级须与入队时相同。*/
+static void prio_del(struct task_struct * p)
+{
+    struct prio_array * array = p->run_array;
+    int prio = task_prio(p);
+    struct task_struct ** head = array->queue + prio;
+
+    if (p->run_next == p) {
+        *head = NULL;
+        array->bitmap[prio>>5] &= ~(1UL << (prio & 31));
+    } else {
+        p->run_prev->run_next = p->run_next;
+        p->run_next->run_prev = p->run_prev;
+        if (*head == p)
+            *head = p->run_next;
+    }
+    p->run_next = p->run_prev = NULL;
+    array->nr_active--;
+}
+
+/* prio_pop,
+ * 取出运行队列array中优先级最高的进程, 队列为空时返回NULL。
+ * bsrl得到bitmap字中最高置位位号。*/
+static struct task_struct * prio_pop(struct prio_array * array)
+{
+    struct task_struct ** head, * p;
+    int i, prio;
+
+    if (!array->nr_active)
+        return NULL;
+    for (i = NR_PRIO/32-1 ; !array->bitmap[i] ; i--)
+        /* nothing */ ;
+    __asm__("bsrl %1,%0":"=r" (prio):"rm" (array->bitmap[i]));
+    prio += i << 5;
+    head = array->queue + prio;
+    p = *head;
+    if (p->run_next == p) {
+        *head = NULL;
+        array->bitmap[i] &= ~(1UL << (prio & 31));
+    } else {
+        p->run_prev->run_next = p->run_next;
+        p->run_next->run_prev = p->run_prev;
+        *head = p->run_next;
+    }
+    p->run_next = p->run_prev = NULL;
+    array->nr_active--;
+    return p;
+}
+
+/* enqueue_task,
+ * 将可运行进程p加入运行队列, 须在关中断下调用。
+ *
+ * 原先每轮重新计算时间片时睡眠进程也会得到counter=counter/2+priority,
+ * 此处在进程入队时补上其睡眠期间错过的各轮计算(计算若干次后counter
+ * 即趋于2*priority, 故至多补8次)。时间片未用完者进入active; 用完者
+ * 按优先级重新获得时间片并进入expired, 在下一轮中运行。
+ *
+ * 实时进程进入rt_array, 时间片(只对SCHED_RR有意义)用完时重新获得
+ * priority个滴答的时间片, 排到同优先级进程之后。*/
+static void enqueue_task(struct task_struct * p)
+{
+    long n = sched_epoch - p->epoch;
+
+    if (rt_task(p)) {
+        if (p->counter <= 0)
+            p->counter = p->priority;
+        p->epoch = sched_epoch;
+        prio_add(&rt_array,p);
+        return;
+    }
+
+    if (n > 8)
+        n = 8;
+    while (n-- > 0)
+        p->counter = (p->counter >> 1) + p->priority;
+    p->epoch = sched_epoch;
+    if (p->counter > 0) {
+        prio_add(active,p);
+        return;
+    }
+    p->counter = p->priority;
+    p->epoch = sched_epoch + 1;
+    prio_add(expired,p);
+}
+
+extern unsigned long tick_stopped;
+void tick_resume(void);
+
+/* wake_up_process,
+ * 将进程p置为可运行状态并加入运行队列。当前进程(还未在schedule中
+ * 切换出去)和已在运行队列中的进程只需置状态; 僵尸进程不可被唤醒。
+ * p为优先级比当前进程高的实时进程时要求调度, 以抢占当前进程。
+ *
+ * 入队时刻以jiffies记录; 空闲时停止了滴答则先补上jiffies, 以免
+ * 把空闲的时间算作等待时间。唤醒时刻另以sched_clock记录, 只用于
+ * 唤醒延迟直方图。*/
+void wake_up_process(struct task_struct * p)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    if (p->state != TASK_ZOMBIE) {
+        p->state = TASK_RUNNING;
+        if (p != current && p->nr && !p->run_next) {
+            enqueue_task(p);
+            if (tick_stopped > 1)
+                tick_resume();
+            p->last_queued = jiffies;
+            p->last_woken = sched_clock();
+            p->woken = 1;
+            if (rt_task(p) && (!rt_task(current) ||
+                p->rt_priority > current->rt_priority))
+                need_resched = 1;
+        }
+    }
+    restore_flags(flags);
+}
+
+/* post_sig,
+ * 为进程p设置信号sig, 不检查权限。信号未被屏蔽(SIGKILL和SIGSTOP不可
+ * 屏蔽)且p在可中断睡眠中时将其唤醒。可在中断中调用。
+ *
+ * 所有设置信号之处都经由本函数, 所以schedule不必再遍历所有进程查找
+ * 有信号待处理的睡眠进程。*/
+void post_sig(struct task_struct * p, long sig)
+{
+    p->signal |= 1 << (sig-1);
+    if (p->state == TASK_INTERRUPTIBLE &&
+        (p->signal & ~(_BLOCKABLE & p->blocked)))
+        wake_up_process(p);
+}
+
 /*
  *  'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
@@ -229,192 +461,222 @@ void math_state_restore()
  * 任务(进程)调度函数。*/
 void schedule(void)
 {
-    int i,next,c;
-    struct task_struct ** p;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
-/* 遍历管理进程的结构体, 检查为各进程所设置的报警是否超时, 若超时则为当
- * 前进程设置报警超时信号。若当前进程被设置了不可屏蔽信号或未被屏蔽信号
- * 且当前进程的状态为准备就绪则为当前进程设置可运行状态, 让其加入可被调
- * 度进程的行列中。
- *
- * jiffies在系统开机时为0,在定时器中断处理函数中每约10ms自增1。在为进程
- * 设置报警超时值alarm时是基于jiffies来设置的, 比如为当前进程设置30ms后
- * 报警超时,alarm=jiffies + 3。所以当alarm < jiffes时表示报警已超时。
+    struct task_struct * next;
+    struct prio_array * array;
+    unsigned long flags;
+    int preempted;
+
+/* wake up the current task if it is about to sleep with a signal pending */
+/* 其他进程的信号在设置时已由post_sig唤醒该进程(报警也由报警定时器在
+ * 定时器中断中经post_sig设置SIGALRM)。只需检查当前进程: 其可能在设置
+ * 可中断睡眠状态之前就已有信号(如信号到达后调用pause), 或自己解除了
+ * 对已有信号的屏蔽, 此时不应睡眠。在进程信号中,有两个信号不可被
+ * blocked屏蔽(SIGKILL和SIGSTOP)。
  *
- * 为进程设置的超时信号将在系统调用完成后被处理(见ret_from_sys_call)。
- *
- * 在进程信号中,有两个信号不可被blocked屏蔽(SIGKILL和SIGSTOP),所以此处
- * 做了判断: 若当前进程需要处理不可屏蔽信号和需要处理未被blocked屏蔽信
- * 号时则将处于就绪状态的进程置于可运行状态,好让该进程在后续处理信号。*/
-    for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-        if (*p) {
-            if ((*p)->alarm && (*p)->alarm < jiffies) {
-                (*p)->signal |= (1<<(SIGALRM-1));
-                (*p)->alarm = 0;
-            }
-            if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-                (*p)->state==TASK_INTERRUPTIBLE)
-                (*p)->state=TASK_RUNNING;
-        }
+ * 信号将在系统调用完成后被处理(见ret_from_sys_call)。*/
+    if (current->state == TASK_INTERRUPTIBLE &&
+        (current->signal & ~(_BLOCKABLE & current->blocked)))
+        current->state = TASK_RUNNING;
 
 /* this is the scheduler proper: */
-/* 调度处于运行状态的进程。遍历处于运行状态的进程,从当前进程切换到时间片
- * 最大的进程。若当前除初始进程外无其他进程运行,则next将保持原本指向初始
- * 进程索引0。若除初始进程外的其余就绪进程的时间片皆为0,则用进程的优先级
- * 设置进程的时间片,然后切换到首次遍历到的时间片为0的进程中运行,该运行进
- * 程的时间片数等于其优先级数。*/
-    while (1) {
-        c = -1;
-        next = 0;
-        i = NR_TASKS;
-        p = &task[NR_TASKS];
-        while (--i) {
-            if (!*--p)
-                continue;
-            if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-                c = (*p)->counter, next = i;
+/* 当前进程仍可运行则将其放回运行队列, 然后先从实时进程中, 没有则从
+ * 普通进程中取出优先级最高的进程运行。active为空时与expired互换, 都
+ * 为空则运行任务0。被抢占(时间片未用完)的实时进程排在同优先级进程
+ * 之前, 让出CPU和时间片用完的排在之后。
+ *
+ * 关中断期间切换进程, 切换回本进程后恢复本进程的标志寄存器。*/
+    save_flags(flags);
+    cli();
+    need_resched = 0;
+    if (current->nr && current->state == TASK_RUNNING) {
+        preempted = rt_task(current) && current->counter > 0;
+        enqueue_task(current);
+        if (preempted)
+            rt_array.queue[current->rt_priority] = current;
+        current->last_queued = jiffies;
+        current->woken = 0;
+    }
+    if (!(next = prio_pop(&rt_array))) {
+        if (!active->nr_active && expired->nr_active) {
+            array = active;
+            active = expired;
+            expired = array;
+            sched_epoch++;
+        }
+        if (!(next = prio_pop(active)))
+            next = task[0];
+    }
+    if (next != current) {
+        /* 调度统计: 当前进程仍可运行则为被动让出CPU, 否则为主动让出;
+         * 下一进程在运行队列中等待的滴答数计入其run_delay, 若其是被
+         * 唤醒的还以sched_clock计时计入唤醒延迟直方图。只有这时才读
+         * sched_clock, 被抢占的进程再次运行时不读。*/
+        if (current->state == TASK_RUNNING)
+            current->nivcsw++;
+        else
+            current->nvcsw++;
+        if (next->nr) {
+            next->run_delay += jiffies - next->last_queued;
+            if (next->woken)
+                sched_latency[log2_bucket(sched_clock() - next->last_woken)]++;
         }
-        if (c) break;
-        for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-            if (*p)
-                (*p)->counter = ((*p)->counter >> 1) + (*p)->priority;
+        next->pcount++;
+        next->last_run = jiffies;
     }
-    switch_to(next); /* 从当前进程切换到时间片最大的进程中运行 */
+    switch_to(next->nr); /* 从当前进程切换到时间片最大的进程中运行 */
+    restore_flags(flags);
+}
+
+/* preempt_intr,
+ * 由硬盘, 软盘, 键盘和串口中断处理程序在返回前调用, cs为被中断处的
+ * 代码段选择符。中断了用户态且要求调度时(如中断唤醒了实时进程)立即
+ * 调度, 不必等到下一个滴答。中断了内核态时由系统调用返回时调度。*/
+void preempt_intr(long cs)
+{
+    if (need_resched && (cs & 3))
+        schedule();
 }
 
+static void cpu_idle(void);
+
 /* sys_pause,
  * 将当前进程置于准备就绪状态,
- * 调用进程调度函数调度时间片最大的进程运行。*/
+ * 调用进程调度函数调度时间片最大的进程运行。
+ * 任务0(空闲进程)在用户态循环调用pause, 由cpu_idle停机等待。*/
 int sys_pause(void)
 {
+    if (current == task[0]) {
+        cpu_idle();
+        return 0;
+    }
     current->state = TASK_INTERRUPTIBLE;
     schedule();
     return 0;
 }
 
-/* sleep_on,
- * 让当前进程进入睡眠,*p最初指向NULL。
+/* add_wait_queue,
+ * 将wait加到等待队列*q的尾部, 须在关中断下调用。*/
+static inline void add_wait_queue(struct wait_queue ** q, struct wait_queue * wait)
+{
+    if (!*q) {
+        *q = wait->next = wait->prev = wait;
+        return;
+    }
+    wait->next = *q;
+    wait->prev = (*q)->prev;
+    (*q)->prev->next = wait;
+    (*q)->prev = wait;
+}
+
+/* remove_wait_queue,
+ * 将wait从等待队列*q中移除, 须在关中断下调用。*/
+static inline void remove_wait_queue(struct wait_queue ** q, struct wait_queue * wait)
+{
+    if (wait->next == wait)
+        *q = NULL;
+    else {
+        wait->prev->next = wait->next;
+        wait->next->prev = wait->prev;
+        if (*q == wait)
+            *q = wait->next;
+    }
+}
+
+/* __sleep_on,
+ * 让当前进程以状态state在等待队列*q上睡眠, 直到被wake_up唤醒
+ * (state为TASK_INTERRUPTIBLE时也可被信号唤醒)。
  *
- * 将当前进程结构体地址赋给p,然后将当前进
- * 程设置为未就绪状态。直到其他进程调用函
- * 数wake_up(p)重新将当前进程设置就绪状态。*/
-void sleep_on(struct task_struct **p)
+ * 队列元素位于本进程内核栈上。入队和置状态都在关中断下进行,
+ * 所以中断处理程序中的wake_up不会在两者之间丢失; schedule
+ * 切换回本进程时恢复关中断状态, 出队后再恢复调用者的标志。
+ * 被唤醒不代表所等条件已满足, 调用者应在循环中重新判断。*/
+static void __sleep_on(struct wait_queue ** q, int state, int flags)
 {
-    struct task_struct *tmp;
+    struct wait_queue wait;
+    unsigned long eflags;
 
-    if (!p)
+    if (!q)
         return;
     if (current == &(init_task.task))
         panic("task[0] trying to sleep");
-
-    /* 用tmp指向实参p指向的进程结构体,
-     * 并让实参p指向当前进程结构体。*/
-    tmp = *p;
-    *p = current;
-
-    /* 将当前进程设置为未就绪状态然后调度
-     * 时间片最大的其他进程运行。*/
-    current->state = TASK_UNINTERRUPTIBLE;
+    wait.task = current;
+    wait.flags = flags;
+    save_flags(eflags);
+    cli();
+    add_wait_queue(q,&wait);
+    current->state = state;
     schedule();
-
-    /* 调用schedule()函数切换其他进程运行后,
-     * 本进程不会再被CPU运行。本进程运行上下
-     * 文将被备份到其TSS中, 包括本函数栈帧状
-     * 态。在本进程被其他进程调用wake_up设置
-     * 为就绪状态且被函数 schedule()切换运行
-     * 后,本进程才会被重新执行即从 switch_to
-     * 中ljmp之后的指令开始执行, 然后从函数
-     * schedule()函数返回到此处从而执行判断
-     * 语句if (tmp)。
-     *
-     * tmp->state=0即将tmp所指向进程即上一个
-     * 调用sleep_on()的进程设置为就绪状态。*/
-    if (tmp)
-        tmp->state=0;
+    remove_wait_queue(q,&wait);
+    restore_flags(eflags);
 }
 
-/* interruptible_sleep_on,
- * 让当前进程进入睡眠。
- * 与sleep_on不同的是,经本函数进入睡眠进程的状态为准备就绪
- * 状态,该状态除可由wake_up唤醒后,还可由信号唤醒即置可运行
- * 状态。如1->2->3->4四个进程依次调用本函数进入睡眠,假设进
- * 程2收到信号,则进程被置就绪状态的顺序为4->3->2->1。*/
-void interruptible_sleep_on(struct task_struct **p)
+/* sleep_on,
+ * 让当前进程在等待队列*q上不可中断地睡眠。*/
+void sleep_on(struct wait_queue ** q)
 {
-    struct task_struct *tmp;
+    __sleep_on(q,TASK_UNINTERRUPTIBLE,0);
+}
 
-    if (!p)
-        return;
-    if (current == &(init_task.task))
-        panic("task[0] trying to sleep");
+/* sleep_on_exclusive,
+ * 同sleep_on, 但为独占等待: 每次wake_up只唤醒一个独占等待的进程。*/
+void sleep_on_exclusive(struct wait_queue ** q)
+{
+    __sleep_on(q,TASK_UNINTERRUPTIBLE,WQ_EXCLUSIVE);
+}
 
-    /* 用tmp指向实参p指向的进程结构体,
-     * 并让实参p指向当前进程结构体。*/
-    tmp=*p;
-    *p=current;
-
-    /* 将当前进程设置为准备就绪状态然后调度
-     * 时间片最大的其他进程运行。准备就绪状
-     * 态除了能被其他进程调用wake_up唤醒外,
-     * 其他进程通过为本进程发送信号的方式将
-     * 本进程再次设置为就绪状态,见schdule()。*/
-repeat:	current->state = TASK_INTERRUPTIBLE;
-    schedule();
+/* interruptible_sleep_on,
+ * 让当前进程在等待队列*q上睡眠, 除由wake_up唤醒外, 还可由信号唤醒
+ * (见schedule)。被信号唤醒的进程只将自己移出队列, 不影响其他等待者。*/
+void interruptible_sleep_on(struct wait_queue ** q)
+{
+    __sleep_on(q,TASK_INTERRUPTIBLE,0);
+}
 
-    /* 当本进程被唤醒且再次切换到本进程
-     * 中时, 后续语句才会被执行。因为调
-     * 用本函数进入睡眠的进程可被信号唤
-     * 醒(见schedule)。所以被唤醒进程有
-     * 可能不是最后一次调用本函数进入睡
-     * 眠的进程, 所以在此处将最后调用本
-     * 函数的进程唤醒并再次将本进程置为
-     * 准备就绪状态后进行进程调度。
-     *
-     * struct task_struct *tmp = NULL;
-     * 假设进程1,2,3,4通过实参tmp 依次
-     * 调用了本函数 1 -> 2 -> 3 -> 4即
-     * interruptible_sleep_on(&tmp);
-     * 
-     * 若通过wake_up(&tmp)陆续唤醒4个进
-     * 程, 该过程同wake_up 唤醒通过调用
-     * sleep_on进入睡眠的进程一样。
-     *
-     * 看看通过信号如何唤醒这4个进程的,
-     * 假设进程2 收到某信号被唤醒后执行
-     * 到此处, 此时*p即tmp指向进程4结构
-     * 体,此处则将最后调用本函数即进程4
-     * 置为就绪状态并重新进入睡眠。待进
-     * 程被运行后, 进程3,2,1 会被依次置
-     * 就绪状态(同调用wake_up唤醒)。*/
-    if (*p && *p != current) {
-        (**p).state=0;
-        goto repeat;
-    }
+/* __wake_up,
+ * 按睡眠先后唤醒等待队列*q中尚在睡眠的进程: 非独占等待者全部唤醒
+ * (包括排在被唤醒的独占等待者之后的), 独占等待者在all为0时只唤醒
+ * 第一个。已被唤醒但还未运行(未出队)的进程不计在内, 所以接连两次
+ * wake_up会唤醒两个独占等待者。*/
+static void __wake_up(struct wait_queue ** q, int all)
+{
+    struct wait_queue * wait;
+    struct task_struct * p;
+    unsigned long flags;
+    int exclusive = 0;
 
-    /* 最后调用本函数的进程被唤醒后, 将唤
-     * 醒上一个调用本函数的进程, 依次类推
-     * 直到tmp = NULL即第一个调用本函数的
-     * 进程为止。*/
-    *p=NULL; /* 复位实参在本进程中所指向的上一个进入睡眠的进程 */
-    if (tmp)
-        tmp->state=0;
+    if (!q)
+        return;
+    save_flags(flags);
+    cli();
+    if ((wait = *q))
+        do {
+            p = wait->task;
+            if (p->state != TASK_UNINTERRUPTIBLE &&
+                p->state != TASK_INTERRUPTIBLE)
+                continue;
+            /* 已唤醒一个独占等待者后继续查找其后的非独占等待者 */
+            if (wait->flags & WQ_EXCLUSIVE) {
+                if (exclusive && !all)
+                    continue;
+                exclusive = 1;
+            }
+            wake_up_process(p);
+        } while ((wait = wait->next) != *q);
+    restore_flags(flags);
 }
 
 /* wake_up,
- * 唤醒由参数*p指向结构体所管理进程,即
- * 为该进程设置为已就绪状态。由wake_up
- * 唤醒的进程为最后调用sleep_on(p)的进
- * 程,该进程将会在sleep_on()函数中唤醒
- * 在他之前调用sleep_on的进程,依次类推
- * 直到唤醒所有调用过sleep_on(p)的进程。*/
-void wake_up(struct task_struct **p)
-{
-    if (p && *p) {
-        (**p).state=0;
-        /* 复位实参在本进程中所指向的上一个进入睡眠的进程 */
-        *p=NULL;
-    }
+ * 唤醒等待队列*q中所有非独占等待的进程和第一个独占等待的进程。*/
+void wake_up(struct wait_queue ** q)
+{
+    __wake_up(q,0);
+}
+
+/* wake_up_all,
+ * 唤醒等待队列*q中的所有进程。*/
+void wake_up_all(struct wait_queue ** q)
+{
+    __wake_up(q,1);
 }
 
 /*
@@ -425,11 +687,11 @@ void wake_up(struct task_struct **p)
 /* 不懂点软盘相关专业知识,这些程序读起来还真是一头雾水,携带一下参考下书籍吧。*/
 
 /* 等待软驱A-D马达启动并到达正常转速的进程指针数组 */
-static struct task_struct * wait_motor[4] = {NULL,NULL,NULL,NULL};
-/* 存储A-D软驱启动所需时间片数的数组 */
-static int  mon_timer[4]={0,0,0,0};
-/* 存储A-D软驱停止所需时间片数的数组 */
-static int moff_timer[4]={0,0,0,0};
+static struct wait_queue * wait_motor[4] = {NULL,NULL,NULL,NULL};
+/* A-D软驱马达启动完成的时刻(jiffies) */
+static unsigned long mon_expires[4]={0,0,0,0};
+/* A-D软驱马达启动完成和停止定时器, 以软驱号为参数 */
+static struct timer_list mon_timer[4], moff_timer[4];
 /* A-D软驱控制器数字输出寄存器值,
  * bit[7..4]: 标识D-A马达是否启动,1-启动;0-关闭。
  * bit[3]: 1/0 - 允许DMA和中断请求/禁止DMA和中断请求。
@@ -437,18 +699,37 @@ static int moff_timer[4]={0,0,0,0};
  * bit[1..0]: 标识当前选择的软驱,[(00)2..(11)2]对应A-D。*/
 unsigned char current_DOR = 0x0C;
 
+/* motor_on_callback,
+ * 软驱nr马达启动完成定时器超时回调函数, 唤醒等待马达启动的进程。*/
+static void motor_on_callback(unsigned long nr)
+{
+    wake_up(nr+wait_motor);
+}
+
+/* motor_off_callback,
+ * 软驱nr马达停止定时器超时回调函数, 复位马达启动位
+ * 并更新记录软盘数字输出寄存器的变量。*/
+static void motor_off_callback(unsigned long nr)
+{
+    unsigned char mask = 0x10 << nr;
+
+    current_DOR &= ~mask;
+    outb(current_DOR,FD_DOR);
+}
+
 /* ticks_to_floppy_on,
  * 指定软驱nr(0-3对应A-D)启动和停止所需等待时间。*/
 int ticks_to_floppy_on(unsigned int nr)
 {
     extern unsigned char selected;
     unsigned char mask = 0x10 << nr;
+    long ticks;
 
     if (nr>3)
         panic("floppy_on: nr>3");
     
-    moff_timer[nr]=10000;   /* 100 s = very big :-) */
     cli();  /* use floppy_off to turn it off */
+    del_timer(nr+moff_timer);
     mask |= current_DOR;
     if (!selected) {
         mask &= 0xFC;
@@ -457,17 +738,22 @@ int ticks_to_floppy_on(unsigned int nr)
     /* 若软盘输出寄存器当前值与要求值不同,
      * 若软驱没有启动则置0.5s的等待启动时
      * 间,若软驱已启动则再置20ms等待时间。*/
+    ticks = mon_expires[nr] - jiffies;
     if (mask != current_DOR) {
         outb(mask,FD_DOR);
         if ((mask ^ current_DOR) & 0xf0)
-            mon_timer[nr] = HZ/2;
-        else if (mon_timer[nr] < 2)
-            mon_timer[nr] = 2;
+            ticks = HZ/2;
+        else if (ticks < 2)
+            ticks = 2;
         current_DOR = mask;
+        mon_expires[nr] = jiffies + ticks;
+        mon_timer[nr].data = nr;
+        mon_timer[nr].function = motor_on_callback;
+        mod_timer(nr+mon_timer,mon_expires[nr]);
     }
     sti();
-    /* 软盘定时值在do_floppy_timer中会被递减 */
-    return mon_timer[nr];
+    /* 马达启动完成定时器到期时唤醒在floppy_on中等待的进程 */
+    return ticks > 0 ? ticks : 0;
 }
 
 /* floppy_on,
@@ -486,129 +772,426 @@ void floppy_on(unsigned int nr)
  * 设置停止软盘马达的等待时间。*/
 void floppy_off(unsigned int nr)
 {
-    moff_timer[nr]=3*HZ;
+    moff_timer[nr].data = nr;
+    moff_timer[nr].function = motor_off_callback;
+    mod_timer(nr+moff_timer,jiffies+3*HZ);
 }
 
-/* do_floppy_timer,
- * 软盘定时器超时C处理函数,该函数被
- * do_timer函数调用,即约每10ms就会被调用一次。*/
-void do_floppy_timer(void)
+/* 分级时间轮。
+ *
+ * 原先的定时器为最多TIME_REQUESTS(64)个元素的数组, 以按剩余时间
+ * 排序的单链表组织, 加入时需遍历链表, 元素用完则panic。现在定时器
+ * 结构体由使用者提供(见include/linux/timer.h), 按到期时刻expires挂
+ * 在5级时间轮的槽中:
+ *   tv1 - 256个槽, 每槽1个滴答, 存放256个滴答内到期的定时器;
+ *   tv2 - 64个槽, 每槽256个滴答; tv3,tv4,tv5依次每槽再乘64。
+ * 槽中的定时器以双向链表链接, 加入和删除都是常数时间。timer_jiffies
+ * 为下一个要处理的时刻, tv1每转完一圈时将上一级当前槽中的定时器重新
+ * 分配到下一级中(cascade_timers), 所以每个定时器至多被移动4次。
+ *
+ * 各级槽为指向其链表首个定时器的指针, 链表首个定时器的prev指向该槽,
+ * 由于next为struct timer_list的第一个成员, 槽可被当作只有next成员的
+ * 定时器对待, 删除时无需区分定时器是否在链表首。*/
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+struct timer_vec {
+    int index;
+    struct timer_list * vec[TVN_SIZE];
+};
+
+struct timer_vec_root {
+    int index;
+    struct timer_list * vec[TVR_SIZE];
+};
+
+static struct timer_vec_root tv1;
+static struct timer_vec tv2, tv3, tv4, tv5;
+static struct timer_vec * const tvecs[] = {
+    (struct timer_vec *) &tv1, &tv2, &tv3, &tv4, &tv5
+};
+#define NOOF_TVECS (sizeof(tvecs) / sizeof(tvecs[0]))
+
+static unsigned long timer_jiffies = 0;
+
+/* internal_add_timer,
+ * 按到期时刻将timer加入时间轮中相应的槽, 须在关中断下调用。
+ * 已到期的定时器加入tv1的当前槽, 在下一次处理定时器时到期。*/
+static void internal_add_timer(struct timer_list * timer)
 {
-    int i;
-    unsigned char mask = 0x10;
-
-    for (i=0 ; i<4 ; i++,mask <<= 1) {
-        if (!(mask & current_DOR))
-            continue;
-        /* 若等待马达启动定时到达则唤醒等待马达启动的进程 */
-        if (mon_timer[i]) {
-            if (!--mon_timer[i])
-                wake_up(i+wait_motor);
-        /* 若等待软盘马达停止超时则复位马达启动
-         * 位并更新记录软盘数字输出寄存器的变量 */
-        } else if (!moff_timer[i]) {
-            current_DOR &= ~mask;
-            outb(current_DOR,FD_DOR);
-        } else
-            moff_timer[i]--; /* 等待软盘马达停止时间片递减 */
-    }
+    unsigned long expires = timer->expires;
+    unsigned long idx = expires - timer_jiffies;
+    struct timer_list ** vec;
+
+    if ((long) idx < 0)
+        vec = tv1.vec + tv1.index;
+    else if (idx < TVR_SIZE)
+        vec = tv1.vec + (expires & TVR_MASK);
+    else if (idx < 1 << (TVR_BITS + TVN_BITS))
+        vec = tv2.vec + ((expires >> TVR_BITS) & TVN_MASK);
+    else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS))
+        vec = tv3.vec + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+    else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS))
+        vec = tv4.vec + ((expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+    else
+        vec = tv5.vec + ((expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+    if ((timer->next = *vec))
+        (*vec)->prev = timer;
+    *vec = timer;
+    timer->prev = (struct timer_list *) vec;
+}
+
+/* detach_timer,
+ * 若timer在时间轮中则将其移出, 须在关中断下调用。*/
+static int detach_timer(struct timer_list * timer)
+{
+    if (!timer->prev)
+        return 0;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    timer->prev->next = timer->next;
+    timer->next = timer->prev = NULL;
+    return 1;
 }
 
-#define TIME_REQUESTS 64
-/* static struct timer_list,
- * 定时器结构体。*/
-static struct timer_list {
-    long jiffies; /* 定时器时间片 */
-    void (*fn)(); /* 定时器超时回调函数 */
-    struct timer_list * next; /* 指向timer_list数组中的上一元素 */
-} timer_list[TIME_REQUESTS], * next_timer = NULL;
- 
 /* add_timer,
- * 往定时器数组timer_list中加入超时时间片为jiffies
- * 超时回调函数为fn的定时器。
+ * 将定时器timer加入时间轮, 在jiffies到达timer->expires时以
+ * timer->data为参数调用timer->function。timer不能已在时间轮中。*/
+void add_timer(struct timer_list * timer)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    if (timer->prev)
+        printk("add_timer: timer already added\n\r");
+    else
+        internal_add_timer(timer);
+    restore_flags(flags);
+}
+
+/* del_timer,
+ * 将定时器timer移出时间轮, timer在时间轮中时返回1, 否则返回0。*/
+int del_timer(struct timer_list * timer)
+{
+    unsigned long flags;
+    int ret;
+
+    save_flags(flags);
+    cli();
+    ret = detach_timer(timer);
+    restore_flags(flags);
+    return ret;
+}
+
+/* mod_timer,
+ * 将定时器timer的到期时刻改为expires, timer可在也可不在时间轮中。*/
+void mod_timer(struct timer_list * timer, unsigned long expires)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+    detach_timer(timer);
+    timer->expires = expires;
+    internal_add_timer(timer);
+    restore_flags(flags);
+}
+
+/* cascade_timers,
+ * 将tv当前槽中的定时器按到期时刻重新分配到下一级中。*/
+static void cascade_timers(struct timer_vec * tv)
+{
+    struct timer_list * timer, * next;
+
+    timer = tv->vec[tv->index];
+    tv->vec[tv->index] = NULL;
+    while (timer) {
+        next = timer->next;
+        internal_add_timer(timer);
+        timer = next;
+    }
+    tv->index = (tv->index + 1) & TVN_MASK;
+}
+
+/* run_timer_list,
+ * 调用到期(expires <= jiffies)的定时器的回调函数, 由do_timer调用。*/
+static void run_timer_list(void)
+{
+    struct timer_list * timer;
+    void (*fn)(unsigned long);
+    unsigned long data;
+    int n;
+
+    while ((long) (jiffies - timer_jiffies) >= 0) {
+        if (!tv1.index) {
+            n = 1;
+            do {
+                cascade_timers(tvecs[n]);
+            } while (tvecs[n]->index == 1 && ++n < NOOF_TVECS);
+        }
+        while ((timer = tv1.vec[tv1.index])) {
+            fn = timer->function;
+            data = timer->data;
+            detach_timer(timer);
+            fn(data);
+        }
+        timer_jiffies++;
+        tv1.index = (tv1.index + 1) & TVR_MASK;
+    }
+}
+
+extern int beepcount;
+extern void sysbeepstop(void);
+
+/* 无滴答空闲。
  *
- * 如往timer_list数组中依次加入3个时间片分别为
- * 10,3,33的定时器的过程
- * |——————————|
- * |jiffies=10|
- * |fn10      |
- * |next=NULL |
- * |——————————|
- * timer_list[0]
- * next_timer = &timer_list[0]
- * 
- * 添加3个时间片超时的定时器
- * |——————————|  |———————————————————|
- * |jiffies=10|  |jiffies=3          |
- * |fn10      |  |fn3                |
- * |next=NULL |  |next=&timer_list[0]|
- * |——————————|  |———————————————————|
- * timer_list[0] timer_list[1]        
- *               next_timer = &timer_list[1]
- * add_timer在处理加入时间片较小定时器时似乎是
- * 有问题的, 应该将timer_list[0]设置为定时器标
- * 兵,该定时器标兵时间片保持为0.
- * 
- * 添加33个时间片超时的定时器
- * |——————————|  |——————————|  |———————————————————|
- * |jiffies=20|  |jiffies=10|  |jiffies=3          |
- * |fn33      |  |fn10      |  |fn10               |
- * |next=NULL |  |next=NULL |  |next=&timer_list[1]|
- * |——————————|  |——————————|  |———————————————————|
- * timer_list[0] timer_list[1] timer_list[2]        
- *                             next_timer = &timer_list[2] */
-void add_timer(long jiffies, void (*fn)(void))
-{
-    struct timer_list * p;
-
-    if (!fn)
-        return;
-    
-    cli(); /* 禁止中断 */
-    /* 若时间片小于等于0则理解执行定时器的超时回调函数 */
-    if (jiffies <= 0)
-        (fn)();
-    /* 否则将定时器加入到定时器数组timer_list中的合理位置上 */
-    else {
-        /* 遍历一个空闲的timer_list元素,将该定时器记录在该空闲元素中 */
-        for (p = timer_list ; p < timer_list + TIME_REQUESTS ; p++)
-            if (!p->fn)
-                break;
-        if (p >= timer_list + TIME_REQUESTS)
-            panic("No more time requests free");
-        p->fn = fn;
-        p->jiffies = jiffies;
-        p->next = next_timer; /* 指向链表头 */
-        next_timer = p;
-        
-        /* 调整新加入定时器在timer_list中的位置,将
-         * timer_list[0]设置为标兵后以下表达式中的"<"应为"<=" */
-        while (p->next && p->next->jiffies < p->jiffies) {
-
-            /* 将插入定时器时间片减去当前定时器时间片
-             * 并交换两个定时器, 直到插入定时器时间片
-             * 比下一个定时器时间片小为止。*/
-            p->jiffies -= p->next->jiffies;
-            fn = p->fn;
-            p->fn = p->next->fn;
-            p->next->fn = fn;
-            jiffies = p->jiffies;
-            p->jiffies = p->next->jiffies;
-            p->next->jiffies = jiffies;
-
-            p = p->next;
+ * 没有可运行的进程时任务0以hlt停机等待中断。若接下来的若干个滴答内
+ * 没有定时器到期(报警也是定时器), 则停机前将定时器0改为方式0单次计数,
+ * 到下一个有定时器到期的滴答才产生中断, 以免空闲时每个滴答都被唤醒。
+ * 定时器0的计数值只有16位, 一次最多停止MAX_IDLE_TICKS个滴答(HZ为100
+ * 时为5个, HZ为1000时为54个), 到时若仍空闲则再停止一次。
+ *
+ * tick_stopped为单次计数到期时应计的滴答数, 为0表示定时器0在周期计数。
+ * 单次计数到期时由do_timer补上停止期间的滴答并恢复周期计数; 停止期间
+ * 被其他中断唤醒时由tick_resume按已过的计数值补上滴答, 再以单次计数
+ * 对齐到下一个滴答(tick_stopped为1), 以免jiffies相对实际时间漂移。
+ * 硬盘和软盘中断处理要用jiffies, 其入口处先调用tick_resume。*/
+#define MAX_IDLE_TICKS (0xffff/LATCH)
+
+unsigned long tick_stopped = 0;
+
+/* timer_irq_pending,
+ * 定时器中断(IRQ0)已发生但还未被处理时返回非0。*/
+static inline int timer_irq_pending(void)
+{
+    outb_p(0x0a,0x20);  /* OCW3: 读IRR */
+    return inb_p(0x20) & 1;
+}
+
+/* tick_start,
+ * 令定时器0每LATCH个计数(即每个滴答)产生一次中断, 同sched_init。*/
+static void tick_start(void)
+{
+    outb_p(0x36,0x43);              /* binary, mode 3, LSB/MSB, ch 0 */
+    outb_p(LATCH & 0xff , 0x40);    /* LSB */
+    outb(LATCH >> 8 , 0x40);        /* MSB */
+    tick_stopped = 0;
+}
+
+/* tick_oneshot,
+ * 令定时器0在count个计数后产生一次中断, 该中断计为ticks个滴答。*/
+static void tick_oneshot(unsigned long count, unsigned long ticks)
+{
+    outb_p(0x30,0x43);              /* binary, mode 0, LSB/MSB, ch 0 */
+    outb_p(count & 0xff , 0x40);
+    outb(count >> 8 , 0x40);
+    tick_stopped = ticks;
+}
+
+/* tick_left,
+ * 返回定时器0到下一个滴答还剩的计数值, tick_stopped不能大于1。
+ * 方式3下每个滴答计数器以2递减两遍, 前半个周期输出为高, 所以用
+ * 回读命令同时锁存状态(bit7为输出)和计数值; 方式0(tick_stopped为1)
+ * 下计数值即为剩余值。*/
+static unsigned long tick_left(void)
+{
+    unsigned long status, count;
+
+    outb_p(0xc2,0x43);  /* read-back: 锁存通道0的状态和计数值 */
+    status = inb_p(0x40);
+    count = inb_p(0x40);
+    count |= inb_p(0x40) << 8;
+    if (!tick_stopped) {
+        count >>= 1;
+        if (status & 0x80)
+            count += LATCH/2;
+    }
+    return count ? count : 1;
+}
+
+/* next_timer_ticks,
+ * 返回到下一个可能有定时器到期的滴答还有几个滴答, 最多max个。
+ * 只看tv1: tv1转完一圈时要将上一级的定时器分配下来, 也算作有定时器。*/
+static unsigned long next_timer_ticks(unsigned long max)
+{
+    unsigned long n;
+    int idx = tv1.index;
+
+    for (n = 1 ; n < max ; n++) {
+        if (tv1.vec[idx] || !idx)
+            break;
+        idx = (idx + 1) & TVR_MASK;
+    }
+    return n;
+}
+
+/* tick_resume,
+ * 在滴答停止期间被其他中断唤醒时调用, 补上已过的滴答。*/
+void tick_resume(void)
+{
+    unsigned long flags, r, m;
+
+    save_flags(flags);
+    cli();
+    if (tick_stopped > 1) {
+        outb_p(0x00,0x43);  /* 锁存定时器0的计数值 */
+        r = inb_p(0x40);
+        r |= inb_p(0x40) << 8;
+        /* 单次计数已到期, 中断处理时补上最后一个滴答并恢复周期计数 */
+        if (timer_irq_pending()) {
+            jiffies += tick_stopped - 1;
+            tick_stopped = 1;
+        } else {
+            /* 还剩r个计数, 其中有m个完整的滴答未过 */
+            if (!r)
+                r = 1;
+            m = (r - 1) / LATCH;
+            jiffies += tick_stopped - 1 - m;
+            tick_oneshot(r - m * LATCH, 1);
         }
     }
+    restore_flags(flags);
+}
+
+/* TSC, Pentium及以后的CPU每个时钟周期加1的64位计数器, rdtsc指令
+ * 读取它只需几十个周期。tsc_mult为每个TSC计数的微秒数乘以2^32,
+ * 为0表示没有TSC(如386)或校准失败。*/
+static unsigned long tsc_mult = 0;
+
+/* rdtsc指令和cpuid指令的机器码 */
+#define rdtsc(low,high) \
+__asm__ __volatile__(".byte 0x0f,0x31":"=a" (low),"=d" (high))
+
+/* has_tsc,
+ * CPU支持cpuid指令(EFLAGS的ID位即位21可被改变)且cpuid功能1报告
+ * 有TSC(EDX位4)时返回非0。386及早期486没有cpuid指令。*/
+static int has_tsc(void)
+{
+    unsigned long f1, f2, a, d;
+
+    __asm__("pushfl\n\t"
+        "popl %0\n\t"
+        "movl %0,%1\n\t"
+        "xorl $0x200000,%0\n\t"
+        "pushl %0\n\t"
+        "popfl\n\t"
+        "pushfl\n\t"
+        "popl %0\n\t"
+        "pushl %1\n\t"
+        "popfl"
+        :"=&r" (f1),"=&r" (f2));
+    if (!((f1 ^ f2) & 0x200000))
+        return 0;
+    __asm__ __volatile__(".byte 0x0f,0xa2"  /* cpuid */
+        :"=a" (a),"=d" (d):"0" (1):"bx","cx");
+    return d & 0x10;
+}
+
+/* CALIBRATE_LATCH, 校准TSC所用的定时器2计数值, 约10ms */
+#define CALIBRATE_LATCH (1193180/100)
+
+/* tsc_init,
+ * 有TSC时用定时器2校准其频率, 设置tsc_mult。
+ * 开定时器2的门控(0x61位0)并关扬声器(位1), 令定时器2以方式0计数
+ * CALIBRATE_LATCH(10000微秒), 计数到0时其输出(0x61位5)变高, 以此间
+ * 的TSC增量delta求出tsc_mult = 10000*2^32/delta。delta不大于10000
+ * (CPU不到1MHz)时商会溢出, 视为没有TSC。*/
+static void tsc_init(void)
+{
+    unsigned long lo1, hi1, lo2, hi2, delta, port;
+
+    if (!has_tsc())
+        return;
+    port = inb_p(0x61);
+    outb_p((port & ~0x02) | 0x01, 0x61);
+    outb_p(0xb0,0x43);                      /* binary, mode 0, LSB/MSB, ch 2 */
+    outb_p(CALIBRATE_LATCH & 0xff , 0x42);  /* LSB */
+    outb_p(CALIBRATE_LATCH >> 8 , 0x42);    /* MSB */
+    rdtsc(lo1,hi1);
+    while (!(inb_p(0x61) & 0x20))
+        /* nothing */;
+    rdtsc(lo2,hi2);
+    outb_p(port,0x61);
+    delta = lo2 - lo1;
+    if (hi2 - hi1 - (lo2 < lo1) || delta <= 10000)
+        return;
+    __asm__("divl %2":"=a" (tsc_mult):"d" (10000),"r" (delta),"0" (0));
+}
+
+/* tsc_usec,
+ * 返回以微秒计的TSC时刻, 即(TSC*tsc_mult)>>32的低32位。
+ * 64位TSC为hi*2^32+lo, 所以结果为(lo*tsc_mult)的高32位加hi*tsc_mult。*/
+static inline unsigned long tsc_usec(void)
+{
+    unsigned long lo, hi, r;
+
+    rdtsc(lo,hi);
+    __asm__("mull %2":"=d" (r),"=a" (lo):"r" (tsc_mult),"1" (lo));
+    return r + hi * tsc_mult;
+}
+
+/* sched_clock,
+ * 返回以微秒计的当前时刻, 32位微秒值约71分钟回绕一次, 只用于求
+ * 差值。可在中断中调用。
+ *
+ * 有TSC时由TSC换算。否则(386)由jiffies和定时器0的剩余计数值合成,
+ * 若计数已回绕而时钟中断还未被处理, 则jiffies还需加1; 这要读定时器
+ * 和中断控制器, 代价较大, 所以调度器只在唤醒延迟直方图中使用。
+ * 块设备延迟统计和跟踪也以此计时(见blk_clock)。*/
+unsigned long sched_clock(void)
+{
+    unsigned long flags, left, j;
+
+    if (tsc_mult)
+        return tsc_usec();
+    save_flags(flags);
+    cli();
+    tick_resume();
+    left = tick_left();
+    j = jiffies;
+    if (timer_irq_pending() && left > LATCH/2)
+        j++;
+    restore_flags(flags);
+    if (left > LATCH)
+        left = LATCH;
+    return j * (1000000/HZ) + (LATCH - left) * (1000000/HZ) / LATCH;
+}
+
+/* cpu_idle,
+ * 任务0的pause。没有可运行进程时停机直到有中断发生, sti的下一条指令
+ * 执行完才响应中断, 所以检查运行队列之后不会漏掉唤醒。醒来后调度被
+ * 中断唤醒的进程运行。*/
+static void cpu_idle(void)
+{
+    unsigned long n;
+
+    cli();
+    if (!rt_array.nr_active && !active->nr_active && !expired->nr_active) {
+        if (!tick_stopped && !beepcount && !timer_irq_pending() &&
+            (n = next_timer_ticks(MAX_IDLE_TICKS)) > 1)
+            tick_oneshot((n - 1) * LATCH + tick_left(), n);
+        __asm__ __volatile__("sti ; hlt ; cli");
+        tick_resume();
+    }
     sti();
+    schedule();
 }
 
 /* do_timer,
  * 定时中断C处理函数。由定时器中断入口处理函
- * 数_timer_interrupt调用,即约每10ms调用一次。*/
+ * 数_timer_interrupt调用,即每个滴答调用一次。*/
 void do_timer(long cpl)
 {
-    extern int beepcount;
-    extern void sysbeepstop(void);
+    /* 单次计数到期, 补上停止期间的滴答并恢复周期计数 */
+    if (tick_stopped) {
+        jiffies += tick_stopped - 1;
+        tick_start();
+    }
 
     /* 当beepcount计数为0时关闭扬声器 */
     if (beepcount)
@@ -621,33 +1204,23 @@ void do_timer(long cpl)
     else
         current->stime++;
 
-    if (next_timer) {
-        next_timer->jiffies--;
-        /* 调用时间片为已0的定时器的回调函数, 并将当前定
-         * 时器的回调函数指针清空,以表该数组元素空闲状态。*/
-        while (next_timer && next_timer->jiffies <= 0) {
-            void (*fn)(void);
-            /* next_timer指向下一个时间片最小的定时器 */
-            fn = next_timer->fn;
-            next_timer->fn = NULL;
-            next_timer = next_timer->next;
-            (fn)();
-        }
-    }
-    /* 软盘马达启动位置位则执行软盘定时程序 */
-    if (current_DOR & 0xf0)
-        do_floppy_timer();
+    /* 调用到期定时器的回调函数 */
+    run_timer_list();
 
-    /* 递减当前进程运行时间片,若时间片未完则不进行进程调度 */
-    if ((--current->counter)>0) return;
+    /* 递减当前进程运行时间片(SCHED_FIFO的实时进程没有时间片),
+     * 时间片运行完毕则要求调度 */
+    if (current->policy != SCHED_FIFO && (--current->counter) <= 0) {
+        current->counter = 0;
+        need_resched = 1;
+    }
 
-    /* 若当前进程时间片运行完毕且不是在
-     * 内核态下则调度时间片最大的进程运行 */
-    current->counter=0;
-    if (!cpl) return;
+    /* 若要求调度(时间片用完或唤醒了更高优先级的实时进程)且不是在
+     * 内核态下则调度优先级最高的进程运行, 在内核态下则在系统调用
+     * 返回时调度 */
+    if (!need_resched || !cpl) return;
     schedule();
 /* 调用schedule()切换到其他进程中运行后,本进程
- * 将阻塞在switch_to()中ljmp之后的一条语句处。
+ * 将阻塞在switch_to()中标号1处。
  * 直到所有进程时间片都运行完毕, 各进程在调度函
  * 数schedule()中重新根据各自优先级获得时间片后,
  * 且本进程再被调度运行时才会从阻塞处返回到此处,
@@ -657,6 +1230,30 @@ void do_timer(long cpl)
 
 /* sys_*, 进程系统调用系列 */
 
+/* alarm_timeout,
+ * 进程报警定时器超时回调函数, 为data所指进程设置SIGALRM信号。*/
+static void alarm_timeout(unsigned long data)
+{
+    struct task_struct * p = (struct task_struct *) data;
+
+    p->alarm = 0;
+    post_sig(p,SIGALRM);
+}
+
+/* set_alarm,
+ * 将当前进程的报警时刻设为expires(jiffies), 为0则取消报警。
+ * 报警定时器到期时为当前进程设置SIGALRM信号。*/
+void set_alarm(long expires)
+{
+    del_timer(&current->alarm_timer);
+    current->alarm = expires;
+    if (expires) {
+        current->alarm_timer.data = (unsigned long) current;
+        current->alarm_timer.function = alarm_timeout;
+        mod_timer(&current->alarm_timer,expires);
+    }
+}
+
 /* sys_alarm,
  * 设置当前进程seconds后报警。*/
 int sys_alarm(long seconds)
@@ -667,9 +1264,8 @@ int sys_alarm(long seconds)
     if (old)
         old = (old - jiffies) / HZ;
     
-    /* 将seconds换算成毫秒后基于当前系统时间片将seconds赋值
-     * alarm以实现当前进程在seconds后超时报警(见schedule())。*/
-    current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+    /* 将seconds换算成时间片后设置报警定时器 */
+    set_alarm((seconds>0)?(jiffies+HZ*seconds):0);
     return (old);
 }
 
@@ -724,6 +1320,139 @@ int sys_nice(long increment)
     return 0;
 }
 
+/* setscheduler,
+ * 将进程id为pid(为0时为当前进程)的进程的调度策略改为policy(为-1时
+ * 不变), 静态优先级改为用户缓冲区param中的值。进程在运行队列中时按
+ * 新的优先级重新入队, 并要求调度以让新的优先级立即生效。*/
+static int setscheduler(int pid, int policy, struct sched_param * param)
+{
+    struct task_struct * p = pid ? find_task_by_pid(pid) : current;
+    unsigned long flags;
+    int prio, queued;
+
+    if (!p)
+        return -ESRCH;
+    if (!param)
+        return -EINVAL;
+    prio = get_fs_long((unsigned long *) &param->sched_priority);
+    if (policy < 0)
+        policy = p->policy;
+    if (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR)
+        return -EINVAL;
+    if (policy == SCHED_OTHER ? prio != 0 : (prio < 1 || prio > MAX_RT_PRIO-1))
+        return -EINVAL;
+    if (p != current && current->euid != p->euid && !suser())
+        return -EPERM;
+    if (policy != SCHED_OTHER && !suser())
+        return -EPERM;
+    save_flags(flags);
+    cli();
+    if ((queued = p->run_next != NULL))
+        prio_del(p);
+    p->policy = policy;
+    p->rt_priority = prio;
+    if (queued)
+        enqueue_task(p);
+    need_resched = 1;
+    restore_flags(flags);
+    return 0;
+}
+
+/* sys_sched_setscheduler,
+ * 设置进程pid的调度策略和静态优先级, 见<sched.h>。*/
+int sys_sched_setscheduler(int pid, int policy, struct sched_param * param)
+{
+    if (policy < 0)
+        return -EINVAL;
+    return setscheduler(pid,policy,param);
+}
+
+/* sys_sched_getscheduler,
+ * 返回进程pid的调度策略。*/
+int sys_sched_getscheduler(int pid)
+{
+    struct task_struct * p = pid ? find_task_by_pid(pid) : current;
+
+    return p ? p->policy : -ESRCH;
+}
+
+/* sys_sched_setparam,
+ * 设置进程pid的静态优先级, 调度策略不变。*/
+int sys_sched_setparam(int pid, struct sched_param * param)
+{
+    return setscheduler(pid,-1,param);
+}
+
+/* sys_sched_getparam,
+ * 将进程pid的静态优先级写到用户缓冲区param中。*/
+int sys_sched_getparam(int pid, struct sched_param * param)
+{
+    struct task_struct * p = pid ? find_task_by_pid(pid) : current;
+
+    if (!p)
+        return -ESRCH;
+    if (!param)
+        return -EINVAL;
+    verify_area(param,sizeof(struct sched_param));
+    put_fs_long(p->rt_priority,(unsigned long *) &param->sched_priority);
+    return 0;
+}
+
+/* sys_sched_get_priority_max, sys_sched_get_priority_min,
+ * 返回调度策略policy的静态优先级的最大值和最小值。*/
+int sys_sched_get_priority_max(int policy)
+{
+    if (policy == SCHED_FIFO || policy == SCHED_RR)
+        return MAX_RT_PRIO-1;
+    return policy == SCHED_OTHER ? 0 : -EINVAL;
+}
+
+int sys_sched_get_priority_min(int policy)
+{
+    if (policy == SCHED_FIFO || policy == SCHED_RR)
+        return 1;
+    return policy == SCHED_OTHER ? 0 : -EINVAL;
+}
+
+/* sys_sched_yield,
+ * 让出CPU。实时进程排到同优先级进程之后; 普通进程放弃本轮剩余的
+ * 时间片, 到下一轮才再运行。*/
+int sys_sched_yield(void)
+{
+    current->counter = 0;
+    schedule();
+    return 0;
+}
+
+/* sys_schedstat,
+ * 将进程id为pid(为0时为当前进程)的进程的调度统计和全系统唤醒延迟
+ * 直方图拷贝到用户缓冲区buf中。*/
+int sys_schedstat(int pid, struct schedstat * buf)
+{
+    struct task_struct * p = pid ? find_task_by_pid(pid) : current;
+    struct schedstat st;
+    int i;
+
+    if (!p)
+        return -ESRCH;
+    verify_area(buf,sizeof(struct schedstat));
+    /* 先在禁止中断时取一份完整的快照 */
+    cli();
+    st.pid = p->pid;
+    st.utime = TICKS_TO_CLOCKS(p->utime);
+    st.stime = TICKS_TO_CLOCKS(p->stime);
+    st.run_delay = p->run_delay * (1000000/HZ);
+    st.pcount = p->pcount;
+    st.nvcsw = p->nvcsw;
+    st.nivcsw = p->nivcsw;
+    st.last_run = TICKS_TO_CLOCKS(p->last_run);
+    for (i=0 ; i<SCHEDSTAT_BUCKETS ; i++)
+        st.latency[i] = sched_latency[i];
+    sti();
+    memcpy_tofs(buf,&st,sizeof(struct schedstat));
+    return 0;
+}
+
 /* sched_init,
  * 任务调度初始化。
  * 
@@ -739,18 +1468,17 @@ void sched_init(void)
         panic("Struct sigaction MUST be 16 bytes");
 
     /* 在GDT中设置初始进程init_task的TSS和LDT。
-     * LDT用于保护应用程序内存段;TSS用于保存进程运行上下文。*/
+     * LDT用于保护应用程序内存段; init_task的TSS为所有进程共用,
+     * 其中的ss0:esp0在切换进程时被设置为下一进程的内核栈顶(见switch_to)。*/
     set_tss_desc(gdt+FIRST_TSS_ENTRY,&(init_task.task.tss));
     set_ldt_desc(gdt+FIRST_LDT_ENTRY,&(init_task.task.ldt));
 
     /* 初始化GDT未用表项;初始化task数组 */
-    p = gdt+2+FIRST_TSS_ENTRY;
+    p = gdt+1+FIRST_LDT_ENTRY;
     for(i=1;i<NR_TASKS;i++) {
         task[i] = NULL;
         p->a=p->b=0;
         p++;
-        p->a=p->b=0;
-        p++;
     }
 /* Clear NT, so that we won't have troubles with that later on */
     /* 复位标志寄存器NT位(若NT置位,执行IRET时会进行任务切换 80386_P7.5) */
@@ -758,7 +1486,7 @@ void sched_init(void)
 
     /* 分别加载初始进程TSS和LDT到TR和LDTR寄存器,
      * 在进入用户态时,CPU会执行TR所指TSS所描述的进程。*/
-    ltr(0);
+    ltr();
     lldt(0);
 /* 粗略理解用户模式下的多任务切换过程。
  * CPU --> TR-->GDT[TR] --> TSS;
@@ -785,6 +1513,9 @@ void sched_init(void)
     outb_p(LATCH & 0xff , 0x40);    /* LSB */
     outb(LATCH >> 8 , 0x40);        /* MSB */
 
+    /* 有TSC时校准其频率, sched_clock用其计时(见tsc_init) */
+    tsc_init();
+
     /* 设置定时器中断处理函数,
      * 允许8259A-1的IRQ0中断,即开启定时器中断。
      * 
@@ -177,19 +177,20 @@ int sys_stime(long * tptr)
 }
 
 /* sys_times,
- * 获取当今进程及其子进程用户态,内核态运行时间(单位为10ms)。*/
+ * 获取当今进程及其子进程用户态,内核态运行时间(单位为10ms)。
+ * 内核以滴答计时, 返回给用户程序时换算为每秒100个时钟数。*/
 int sys_times(struct tms * tbuf)
 {
     if (tbuf) {
         /* 写时拷贝tbuf所指内存段所在内存页 */
         verify_area(tbuf,sizeof *tbuf);
         /* 将时间拷贝到用户内存空间 */
-        put_fs_long(current->utime,(unsigned long *)&tbuf->tms_utime);
-        put_fs_long(current->stime,(unsigned long *)&tbuf->tms_stime);
-        put_fs_long(current->cutime,(unsigned long *)&tbuf->tms_cutime);
-        put_fs_long(current->cstime,(unsigned long *)&tbuf->tms_cstime);
+        put_fs_long(TICKS_TO_CLOCKS(current->utime),(unsigned long *)&tbuf->tms_utime);
+        put_fs_long(TICKS_TO_CLOCKS(current->stime),(unsigned long *)&tbuf->tms_stime);
+        put_fs_long(TICKS_TO_CLOCKS(current->cutime),(unsigned long *)&tbuf->tms_cutime);
+        put_fs_long(TICKS_TO_CLOCKS(current->cstime),(unsigned long *)&tbuf->tms_cstime);
     }
-    return jiffies;
+    return TICKS_TO_CLOCKS(jiffies);
 }
 
 /* sys_brk,
@@ -213,23 +214,21 @@ int sys_brk(unsigned long end_data_seg)
  * 设置进程id为pid进程的组id。*/
 int sys_setpgid(int pid, int pgid)
 {
-    int i;
+    struct task_struct * p;
 
     if (!pid)
         pid = current->pid;
     if (!pgid)
         pgid = current->pid;
-    for (i=0 ; i<NR_TASKS ; i++)
-        if (task[i] && task[i]->pid==pid) {
-            if (task[i]->leader) /* 不能设置会话领导进程的组id */
-                return -EPERM;
-            /* 当前进程与目标进程不属同一会话不能设置 */
-            if (task[i]->session != current->session)
-                return -EPERM;
-            task[i]->pgrp = pgid;
-            return 0;
-        }
-    return -ESRCH;
+    if (!(p = find_task_by_pid(pid)))
+        return -ESRCH;
+    if (p->leader) /* 不能设置会话领导进程的组id */
+        return -EPERM;
+    /* 当前进程与目标进程不属同一会话不能设置 */
+    if (p->session != current->session)
+        return -EPERM;
+    set_pgrp(p,pgid);
+    return 0;
 }
 
 /* sys_getpgrp,
@@ -248,7 +247,8 @@ int sys_setsid(void)
         return -EPERM;
     current->leader = 1;
     /* 当前进程会话号和当前进程组id=当前进程id*/
-    current->session = current->pgrp = current->pid;
+    set_session(current,current->pid);
+    set_pgrp(current,current->pid);
     current->tty = -1;
     return current->pgrp;
 }
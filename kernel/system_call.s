@@ -71,13 +71,13 @@ sa_flags = 8
 sa_restorer = 12
 
 /* 系统调用个数 */
-nr_system_calls = 72
+nr_system_calls = 83
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
  * strange reason. Urgel. Now I just ignore them.
  */
-.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
+.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve,_ret_from_fork
 .globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
 .globl _device_not_available, _coprocessor_error
 
@@ -139,6 +139,10 @@ _system_call:
     cmpl $0,counter(%eax)
     je reschedule
 
+    /* 唤醒了优先级更高的实时进程等要求调度时进行任务调度 */
+    cmpl $0,_need_resched
+    jne reschedule
+
 /* 这是每个系统调用和中断处理程序执行完毕后都会跳转执
  * 行的子程序,该子程序用于处理当前任务所需处理的信号。*/
 ret_from_sys_call:
@@ -308,6 +312,21 @@ _sys_fork:
 # 返回到_system_call中call _sys_call_table(,%eax,4)之后语句处
 1:  ret
 
+/* _ret_from_fork,
+ * 子进程首次被switch_to切换运行时从此处开始执行(见fork.c/copy_process)。
+ * 弹出switch_to保存的gs,fs和父进程的ebp,edi,esi, 此时栈中内容与
+ * _system_call完成系统调用后相同(eax=0), 开中断后经ret_from_sys_call
+ * 返回用户态。*/
+.align 2
+_ret_from_fork:
+    pop %gs
+    pop %fs
+    popl %ebp
+    popl %edi
+    popl %esi
+    sti
+    jmp ret_from_sys_call
+
 /* _hd_interrupt,
  * 设置在IDT[0x2e]中的硬盘中断入口程序。
  * 当通过hd_out函数向硬盘下发读写等命令后,
@@ -332,7 +351,10 @@ _hd_interrupt:
     mov %ax,%es
     movl $0x17,%eax # 加载用户数据段LDT[2]到fs
     mov %ax,%fs
-    movb $0x20,%al  # 见setup.s中对8259A的设置
+    cmpl $1,_tick_stopped # 空闲时停止了滴答则先补上jiffies(见sched.c)
+    jbe 2f
+    call _tick_resume
+2:  movb $0x20,%al  # 见setup.s中对8259A的设置
     outb %al,$0xA0  # EOI to interrupt controller #1
     jmp 1f          # give port chance to breathe
 1:  jmp 1f
@@ -343,6 +365,9 @@ _hd_interrupt:
     movl $_unexpected_hd_interrupt,%edx # 若do_hd函数指针为NULL,则赋值此函数给do_hd。
 1:  outb %al,$0x20
     call *%edx  # "interesting" way of handling intr,如read_intr, write_intr etc.
+    pushl 28(%esp)  # 被中断处的cs, 中断唤醒了实时进程时立即调度
+    call _preempt_intr
+    addl $4,%esp
 # 中断函数执行完毕后, 从栈中恢复寄存器的值, 同时执行iret恢复中断现场。
     pop %fs
     pop %es
@@ -373,7 +398,10 @@ _floppy_interrupt:
     mov %ax,%es
     movl $0x17,%eax
     mov %ax,%fs
-    movb $0x20,%al
+    cmpl $1,_tick_stopped
+    jbe 2f
+    call _tick_resume
+2:  movb $0x20,%al
     outb %al,$0x20  # EOI to interrupt controller #1
     xorl %eax,%eax
     xchgl _do_floppy,%eax
@@ -381,6 +409,9 @@ _floppy_interrupt:
     jne 1f
     movl $_unexpected_floppy_interrupt,%eax
 1:  call *%eax  # "interesting" way of handling intr.
+    pushl 28(%esp)
+    call _preempt_intr
+    addl $4,%esp
     pop %fs
     pop %es
     pop %ds
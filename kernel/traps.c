@@ -155,12 +155,10 @@ static void die(char * str,long esp_ptr,long nr)
             printk("%p ",get_seg_long(0x17,i+(long *)esp[3]));
         printk("\n");
     }
-    /* 获取当前任务TSS在GDT中的编号给变量i */
-    str(i);
-    /* 打印当前任务的进程号, TSS号,
+    /* 打印当前任务的进程号, 任务号,
      * 以及中断发生处的10字节内容,
      * esp[1]为用户程序中断发生时eip的值。*/
-    printk("Pid: %d, process nr: %d\n\r",current->pid,0xffff & i);
+    printk("Pid: %d, process nr: %d\n\r",current->pid,current->nr);
     for(i=0;i<10;i++)
         printk("%02x ",0xff & get_seg_byte(esp[1],(i+(char *)esp[0])));
     printk("\n\r");
@@ -0,0 +1,390 @@
+/*
+ *  linux/mm/filemap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/* filemap.c 实现普通文件数据的页缓存。
+ *
+ * 以(设备号, i节点号, 页中首个逻辑块在文件中的块号)标识文件中的一页
+ * 数据, file_read, file_write和缺页处理do_no_page共用页缓存中的同一页:
+ * 读文件时块设备直接将逻辑块读入页中, 不再经缓冲区块中转拷贝; 可执行
+ * 文件的整页以只读方式直接映射给进程, 进程写该页时由写时拷贝复制一份。
+ *
+ * 缓冲区块仍缓存文件写和i节点, 目录, 间接块等元数据。文件写先写到
+ * 缓冲区块中, 再同步更新页缓存中已有的页; 从设备填充页之前先查看缓冲
+ * 区中是否有该逻辑块(可能还未写盘), 有则以缓冲区中的数据为准。
+ *
+ * 虚拟硬盘上的文件不经页缓存(见PAGE_CACHED), 其缓冲区块已直接指向
+ * 虚拟硬盘内存, 再缓存一份只会多占内存并多拷贝一次。
+ *
+ * 页缓存不单独限制大小, get_free_page()无空闲页时调用shrink_cache_pages()
+ * 回收最久未被引用且未被进程映射的页。*/
+
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+#define NR_PAGE_HASH 307
+#define _pagehashfn(dev,ino,block) \
+    (((unsigned)((dev)^(ino)^(block)))%NR_PAGE_HASH)
+#define page_hash(dev,ino,block) page_hash_table[_pagehashfn(dev,ino,block)]
+
+static struct cache_page * page_hash_table[NR_PAGE_HASH];
+/* 未被引用页的LRU双向循环链表, 表头最久未被引用 */
+static struct cache_page * page_lru = NULL;
+/* 空闲页缓存项单链表(经p_next链接) */
+static struct cache_page * free_entries = NULL;
+
+static inline void wait_on_buffer(struct buffer_head * bh)
+{
+    cli();
+    while (bh->b_lock)
+        sleep_on(&bh->b_wait);
+    sti();
+}
+
+static inline void remove_page_hash(struct cache_page * p)
+{
+    if (p->p_next)
+        p->p_next->p_prev = p->p_prev;
+    if (p->p_prev)
+        p->p_prev->p_next = p->p_next;
+    if (page_hash(p->p_dev,p->p_ino,p->p_block) == p)
+        page_hash(p->p_dev,p->p_ino,p->p_block) = p->p_next;
+    p->p_next = p->p_prev = NULL;
+    p->p_hashed = 0;
+}
+
+static inline void insert_page_hash(struct cache_page * p)
+{
+    p->p_prev = NULL;
+    if (p->p_next = page_hash(p->p_dev,p->p_ino,p->p_block))
+        p->p_next->p_prev = p;
+    page_hash(p->p_dev,p->p_ino,p->p_block) = p;
+    p->p_hashed = 1;
+}
+
+static inline void remove_page_lru(struct cache_page * p)
+{
+    if (p->p_next_lru == p)
+        page_lru = NULL;
+    else {
+        p->p_prev_lru->p_next_lru = p->p_next_lru;
+        p->p_next_lru->p_prev_lru = p->p_prev_lru;
+        if (page_lru == p)
+            page_lru = p->p_next_lru;
+    }
+    p->p_next_lru = p->p_prev_lru = NULL;
+}
+
+static inline void insert_page_lru(struct cache_page * p)
+{
+    if (!page_lru) {
+        page_lru = p->p_next_lru = p->p_prev_lru = p;
+        return;
+    }
+    p->p_next_lru = page_lru;
+    p->p_prev_lru = page_lru->p_prev_lru;
+    page_lru->p_prev_lru->p_next_lru = p;
+    page_lru->p_prev_lru = p;
+}
+
+/* 释放页缓存项p的页内存, 并将p放回空闲页缓存项链表 */
+static inline void free_cache_entry(struct cache_page * p)
+{
+    free_page(p->p_page);
+    p->p_page = 0;
+    p->p_next = free_entries;
+    free_entries = p;
+}
+
+/* get_cache_entry,
+ * 从空闲页缓存项链表取一项, 链表为空时申请一页内存分成若干项。
+ * 页缓存项所占内存不再释放。本函数不会睡眠。*/
+static struct cache_page * get_cache_entry(void)
+{
+    struct cache_page * p;
+    unsigned long page;
+    int i;
+
+    if (!free_entries) {
+        if (!(page = get_free_page()))
+            return NULL;
+        p = (struct cache_page *) page;
+        for (i = PAGE_SIZE/sizeof(struct cache_page) ; i > 0 ; i--,p++) {
+            p->p_next = free_entries;
+            free_entries = p;
+        }
+    }
+    p = free_entries;
+    free_entries = p->p_next;
+    return p;
+}
+
+/* find_page,
+ * 在页缓存中查找(dev,ino,block)所标识的页,
+ * 找到则增加其引用计数并返回, 否则返回NULL。*/
+static struct cache_page * find_page(int dev, int ino, unsigned long block)
+{
+    struct cache_page * p;
+
+    for (p = page_hash(dev,ino,block) ; p ; p = p->p_next)
+        if (p->p_dev == dev && p->p_ino == ino && p->p_block == block) {
+            if (!p->p_count++)
+                remove_page_lru(p);
+            return p;
+        }
+    return NULL;
+}
+
+/* get_cache_page,
+ * 获取inode所指文件中首块为block的页, 不在页缓存中时分配一页并映射
+ * 其各逻辑块(不读数据)。文件末尾之后和空洞处的逻辑块视为全0。
+ * 返回的页已增加引用计数, 内存不足时返回NULL。
+ *
+ * bmap可能读间接块而睡眠, 睡眠期间该页可能已被其他进程加入页缓存,
+ * 所以在分配前需再查找一次。*/
+static struct cache_page * get_cache_page(struct m_inode * inode,
+    unsigned long block)
+{
+    struct cache_page * p;
+    struct buffer_head * bh;
+    int nr[PAGE_BLOCKS];
+    int i;
+
+    if (p = find_page(inode->i_dev,inode->i_num,block))
+        return p;
+    for (i=0 ; i<PAGE_BLOCKS ; i++)
+        if ((block+i)*BLOCK_SIZE < inode->i_size)
+            nr[i] = bmap(inode,block+i);
+        else
+            nr[i] = 0;
+    if (p = find_page(inode->i_dev,inode->i_num,block))
+        return p;
+    if (!(p = get_cache_entry()))
+        return NULL;
+    /* 页内存已被get_free_page清0 */
+    if (!(p->p_page = get_free_page())) {
+        p->p_next = free_entries;
+        free_entries = p;
+        return NULL;
+    }
+    p->p_dev = inode->i_dev;
+    p->p_ino = inode->i_num;
+    p->p_block = block;
+    p->p_count = 1;
+    p->p_uptodate = 0;
+    p->p_next_lru = p->p_prev_lru = NULL;
+    for (i=0 ; i<PAGE_BLOCKS ; i++) {
+        bh = p->p_bh + i;
+        bh->b_data = (char *) p->p_page + i*BLOCK_SIZE;
+        bh->b_blocknr = nr[i];
+        bh->b_dev = inode->i_dev;
+        bh->b_uptodate = !nr[i];
+        bh->b_dirt = 0;
+        bh->b_count = 1;
+        bh->b_lock = 0;
+        bh->b_wait = NULL;
+        bh->b_prev = bh->b_next = NULL;
+        bh->b_prev_free = bh->b_next_free = NULL;
+        bh->b_reqnext = NULL;
+        /* 缓冲区中已有的逻辑块直接拷贝, 不再从设备读 */
+        if (nr[i] && copy_cached_block(inode->i_dev,nr[i],bh->b_data) > 0)
+            bh->b_uptodate = 1;
+    }
+    insert_page_hash(p);
+    return p;
+}
+
+/* fill_cache_page,
+ * 将页p中还未读入的逻辑块以READ方式读入页中并等待其完成。
+ * 在读之前等待已在读的逻辑块, 并再次查看缓冲区中是否有该逻辑块。
+ * 全部逻辑块读入成功时返回1, 否则返回0。*/
+static int fill_cache_page(struct cache_page * p)
+{
+    struct buffer_head * bh;
+    int i, r;
+
+    for (i=0 ; i<PAGE_BLOCKS ; i++) {
+        bh = p->p_bh + i;
+        wait_on_buffer(bh);
+        if (bh->b_uptodate)
+            continue;
+        /* 缓冲区块正在被读写时等其解锁后再拷贝 */
+        while ((r = copy_cached_block(bh->b_dev,bh->b_blocknr,bh->b_data)) < 0)
+            brelse(get_hash_table(bh->b_dev,bh->b_blocknr));
+        if (r)
+            bh->b_uptodate = 1;
+        else
+            ll_rw_block(READ,bh);
+    }
+    for (i=0 ; i<PAGE_BLOCKS ; i++) {
+        bh = p->p_bh + i;
+        wait_on_buffer(bh);
+        if (!bh->b_uptodate)
+            return 0;
+    }
+    p->p_uptodate = 1;
+    return 1;
+}
+
+/* find_cache_page,
+ * 获取inode所指文件中首块为block的页, 并确保页中数据有效。
+ * 返回的页已增加引用计数, 由release_cache_page释放; 读失败或
+ * 内存不足时返回NULL。本函数可能睡眠。*/
+struct cache_page * find_cache_page(struct m_inode * inode,
+    unsigned long block)
+{
+    struct cache_page * p;
+
+    if (!(p = get_cache_page(inode,block)))
+        return NULL;
+    if (p->p_uptodate || fill_cache_page(p))
+        return p;
+    release_cache_page(p);
+    return NULL;
+}
+
+/* prepare_cache_page,
+ * 为预读准备inode所指文件中首块为block的页。若该页已在页缓存中
+ * 则返回NULL, 否则返回新分配的页(已增加引用计数), 由调用者随后
+ * 以start_cache_page提交读请求。本函数可能睡眠。*/
+struct cache_page * prepare_cache_page(struct m_inode * inode,
+    unsigned long block)
+{
+    struct cache_page * p;
+
+    if (p = find_page(inode->i_dev,inode->i_num,block)) {
+        release_cache_page(p);
+        return NULL;
+    }
+    return get_cache_page(inode,block);
+}
+
+/* start_cache_page,
+ * 以READA方式提交页p中还未读入的逻辑块, 不等待读完成。
+ * 请求项不足时放弃, 留待find_cache_page以READ读入。
+ * 本函数不会睡眠, 可在堵塞设备请求队列期间调用。*/
+void start_cache_page(struct cache_page * p)
+{
+    struct buffer_head * bh;
+    int i;
+
+    for (i=0 ; i<PAGE_BLOCKS ; i++) {
+        bh = p->p_bh + i;
+        if (!bh->b_uptodate && !bh->b_lock)
+            ll_rw_block(READA,bh);
+    }
+}
+
+/* release_cache_page,
+ * 释放对页p的引用。引用计数为0时, 页若仍在页缓存中则放入LRU链表尾,
+ * 否则(已被移出页缓存)等待其上的读完成后释放页内存。*/
+void release_cache_page(struct cache_page * p)
+{
+    int i;
+
+    if (!p)
+        return;
+    if (!p->p_count)
+        panic("Trying to free free cache page");
+    if (--p->p_count)
+        return;
+    if (p->p_hashed) {
+        insert_page_lru(p);
+        return;
+    }
+    for (i=0 ; i<PAGE_BLOCKS ; i++)
+        wait_on_buffer(p->p_bh + i);
+    free_cache_entry(p);
+}
+
+/* drop_cache_page,
+ * 将页p移出页缓存, 页p无人引用时将其释放(可能睡眠)。*/
+static void drop_cache_page(struct cache_page * p)
+{
+    remove_page_hash(p);
+    if (p->p_count)
+        return;
+    remove_page_lru(p);
+    p->p_count++;
+    release_cache_page(p);
+}
+
+/* update_cache_page,
+ * 文件写将inode所指文件第block块偏移offset处的count字节写入缓冲区块
+ * 后调用本函数, 将所写内容(data为其在缓冲区块中的地址)同步到页缓存中
+ * 包含该块的页。逻辑块可能属于按页对齐的文件页, 也可能属于可执行文件
+ * 的页(可执行文件首块为文件头, 其页从第1块开始), 两者都需更新。
+ * 页中数据还未读入完成时直接将页移出页缓存, 下次读时重新填充。*/
+void update_cache_page(struct m_inode * inode, unsigned long block,
+    int offset, char * data, int count)
+{
+    struct cache_page * p;
+    unsigned long first[2];
+    int i;
+
+    first[0] = block & ~(PAGE_BLOCKS-1);
+    first[1] = block ? ((block-1) & ~(PAGE_BLOCKS-1)) + 1 : first[0];
+    for (i=0 ; i<2 ; i++) {
+        if (i && first[1] == first[0])
+            break;
+        if (!(p = find_page(inode->i_dev,inode->i_num,first[i])))
+            continue;
+        if (p->p_uptodate)
+            memcpy((char *) p->p_page + (block-first[i])*BLOCK_SIZE + offset,
+                data, count);
+        else
+            remove_page_hash(p);
+        release_cache_page(p);
+    }
+}
+
+/* invalidate_cache_pages,
+ * 将设备dev上i节点号为ino的文件(ino为0时为dev上所有文件)的页
+ * 移出页缓存。仍被引用或被进程映射的页在最后一个引用释放时才释放。*/
+void invalidate_cache_pages(int dev, int ino)
+{
+    struct cache_page * p;
+    int i;
+
+    for (i=0 ; i<NR_PAGE_HASH ; i++) {
+repeat:
+        for (p = page_hash_table[i] ; p ; p = p->p_next)
+            if (p->p_dev == dev && (!ino || p->p_ino == ino)) {
+                drop_cache_page(p);
+                goto repeat;
+            }
+    }
+}
+
+/* shrink_cache_pages,
+ * 从LRU链表头开始回收一页未被进程映射且不在读的页。
+ * 成功回收返回1, 否则返回0。本函数不会睡眠, 由get_free_page调用。*/
+int shrink_cache_pages(void)
+{
+    struct cache_page * p;
+    int i;
+
+    if (!(p = page_lru))
+        return 0;
+    do {
+        if (mem_map[MAP_NR(p->p_page)] == 1) {
+            for (i=0 ; i<PAGE_BLOCKS ; i++)
+                if (p->p_bh[i].b_lock)
+                    break;
+            if (i == PAGE_BLOCKS) {
+                remove_page_hash(p);
+                remove_page_lru(p);
+                free_cache_entry(p);
+                return 1;
+            }
+        }
+        p = p->p_next_lru;
+    } while (p != page_lru);
+    return 0;
+}
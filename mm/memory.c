@@ -52,15 +52,12 @@ __asm__("movl %%eax,%%cr3"::"a" (0))
 
 /* these are not to be changed without changing head.s etc */
 /* 若要修改以下宏常量, 则需在head.s中对页相关程序进行相应的修改。*/
-/* LOW_MEM - 实模式内存大小。
+/* LOW_MEM和MAP_NR(addr)定义在include/linux/mm.h中。
  * PAGING_MEMORY - linux 0.11将会管理扩展内存的最大值。
  * PAGING_PAGES - PAGING_MEMORY内存的页数。
- * MAP_NR(addr) - 计算addr在扩展内存中的页偏移。
  * USED - 内存页引用计数。*/
-#define LOW_MEM 0x100000
 #define PAGING_MEMORY (15*1024*1024)
 #define PAGING_PAGES (PAGING_MEMORY>>12)
-#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
 #define USED 100
 
 #define CODE_SPACE(addr) ((((addr)+4095)&~4095) < \
@@ -94,19 +91,19 @@ __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
  * 内存段[0x100000 + i << 12, 0x100000 + i << 12 + 0xfff]
  * 的引用计数为count, i = [0..PAGING_PAGES - 1].
  * 下标i为mem_map所映射内存页在扩展内存中的页偏移。*/
-static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+unsigned char mem_map [ PAGING_PAGES ] = {0,};
 
 /*
  * Get physical address of first (actually last :-) free page, and mark it
  * used. If no free pages left, return 0.
  */
-/* [3] get_free_page,
+/* [3] find_free_page,
  * 从mem_map数组末尾开始往前遍历,返回首个
  * 引用计数为0的mem_map元素所对应物理内存
  * 页的首地址(见mem_map处注释),并在该元素
  * mem_map中增加该内存页的引用计数;若无空
  * 闲内存页则返回0。*/
-unsigned long get_free_page(void)
+static unsigned long find_free_page(void)
 {
 /* 为啥不是eax ? */
 register unsigned long __res asm("ax");
@@ -171,6 +168,20 @@ __asm__("std ; repne ; scasb\n\t"
 return __res;
 }
 
+/* [3.1] get_free_page,
+ * 获取一页空闲内存页。无空闲内存页时逐页回收页缓存中
+ * 未被使用的页(见mm/filemap.c), 仍无空闲内存页时返回0。
+ * 本函数不会睡眠。*/
+unsigned long get_free_page(void)
+{
+    unsigned long page;
+
+    while (!(page = find_free_page()))
+        if (!shrink_cache_pages())
+            break;
+    return page;
+}
+
 /*
  * Free a page of memory at physical address 'addr'. Used by
  * 'free_page_tables()'
@@ -341,26 +352,16 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
     return 0;
 }
 
-/*
- * This function puts a page in memory at the wanted address.
- * It returns the physical address of the page gotten, 0 if
- * out of memory (either when trying to access page-table or
- * page.)
- */
-/* [7] put_page,
- * 该函数将内存页page映射给一个32位的内存地址address。
- * 完成映射后, address通过页变换后会访问到物理内存页page。*/
-unsigned long put_page(unsigned long page,unsigned long address)
+/* [7.1] map_page,
+ * 以属性prot(7为用户可读写, 5为用户只读)将内存页page映射给
+ * 32位内存地址address。需要时为address分配页表, 内存不足时返回0。*/
+static unsigned long map_page(unsigned long page,unsigned long address,
+    unsigned long prot)
 {
     unsigned long tmp, *page_table;
 
 /* NOTE !!! This uses the fact that _pg_dir=0 */
 
-    if (page < LOW_MEM || page >= HIGH_MEMORY)
-        printk("Trying to put page %p at %p\n",page,address);
-    if (mem_map[(page-LOW_MEM)>>12] != 1)
-        printk("mem_map disagrees with %p at %p\n",page,address);
-
     /* 32位内存地址address高10位为其页表信息在页目录中的偏移,
      * 由于页目录起始地址为0, 此偏移即为页表信息的内存地址。*/
     page_table = (unsigned long *) ((address>>20) & 0xffc);
@@ -382,11 +383,29 @@ unsigned long put_page(unsigned long page,unsigned long address)
     /* 根据32位内存地址address的中间10位计算出其页表项在页表中的偏移,
      * 并在该偏移处设置页表项以存储
      * 内存页page的首地址及其可读可写等属性信息。*/
-    page_table[(address>>12) & 0x3ff] = page | 7;
+    page_table[(address>>12) & 0x3ff] = page | prot;
 /* no need for invalidate */
     return page;
 }
 
+/*
+ * This function puts a page in memory at the wanted address.
+ * It returns the physical address of the page gotten, 0 if
+ * out of memory (either when trying to access page-table or
+ * page.)
+ */
+/* [7] put_page,
+ * 该函数将内存页page映射给一个32位的内存地址address。
+ * 完成映射后, address通过页变换后会访问到物理内存页page。*/
+unsigned long put_page(unsigned long page,unsigned long address)
+{
+    if (page < LOW_MEM || page >= HIGH_MEMORY)
+        printk("Trying to put page %p at %p\n",page,address);
+    if (mem_map[(page-LOW_MEM)>>12] != 1)
+        printk("mem_map disagrees with %p at %p\n",page,address);
+    return map_page(page,address,7);
+}
+
 /* [8]up_wp_page,
  * 实现页表项table_entry所映射内存页的写时拷贝。
  * 
@@ -584,7 +603,7 @@ static int try_to_share(unsigned long address, struct task_struct * p)
  * (该函数跟进程、文件相关, 可了解进程和文件后回读)。*/
 static int share_page(unsigned long address)
 {
-    struct task_struct ** p;
+    struct task_struct * p;
 
     /* current指向当前正在运行的进程,
      * 其中的executable字段指向当前进程的可执行程序文件
@@ -598,14 +617,12 @@ static int share_page(unsigned long address)
         return 0;
     /* 寻找到与当前进程的可执行程序文件相同的进程,
      * 将其内存空间中地址为address处所映射的内存页与当前进程共享。*/
-    for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-        if (!*p)
+    for_each_task(p) {
+        if (current == p)
             continue;
-        if (current == *p)
+        if (p->executable != current->executable)
             continue;
-        if ((*p)->executable != current->executable)
-            continue;
-        if (try_to_share(address,*p))
+        if (try_to_share(address,p))
             return 1;
     }
     return 0;
@@ -618,6 +635,7 @@ void do_no_page(unsigned long error_code,unsigned long address)
     int nr[4];
     unsigned long tmp;
     unsigned long page;
+    struct cache_page * cp;
     int block,i;
 
     address &= 0xfffff000;
@@ -633,18 +651,40 @@ void do_no_page(unsigned long error_code,unsigned long address)
     if (share_page(tmp))
         return;
 
-    /* 若没有与当前进程共用可执行程序文件的进程则申请一页内存 */
-    if (!(page = get_free_page()))
-        oom();
 /* remember that 1 block is used for header */
-    /* 在没有进程与当前进程共用可执行程序文件的情况下,
-     * 需要将该页在可执行程序文件中对应的内容读到内存页中来。
-     * 从可执行程序文件中读取一页数据涉及文件系统和缓冲区buffer管理
-     * 内容, 可暂时略过两个函数的细节内容。待对他们有所了解后回读。*/
+    /* 从页缓存获取该页在可执行程序文件中对应的内容(见mm/filemap.c)。
+     * 整页都在end_data之内时将页缓存中的页以只读方式直接映射给address,
+     * 进程写该页时由写时拷贝复制一份; 含bss段的末页则需拷贝一份。
+     * 内核态(error_code位2为0)写用户内存时不受页只读属性限制,
+     * 所以内核态引起的缺页也拷贝一份, 以免内核写坏页缓存中的页。
+     * 虚拟硬盘上的可执行文件不经页缓存, 直接从指向虚拟硬盘内存的
+     * 缓冲区块拷贝到进程页中。*/
     block = 1 + tmp/BLOCK_SIZE;
-    for (i=0 ; i<4 ; block++,i++)
-        nr[i] = bmap(current->executable,block);
-    bread_page(page,current->executable->i_dev,nr);
+    cp = NULL;
+    if (PAGE_CACHED(current->executable->i_dev))
+        cp = find_cache_page(current->executable,block);
+    if (cp && (error_code & 4) && tmp + PAGE_SIZE <= current->end_data) {
+        page = cp->p_page;
+        mem_map[MAP_NR(page)]++;
+        release_cache_page(cp);
+        if (map_page(page,address,5))
+            return;
+        free_page(page);
+        oom();
+    }
+
+    /* 申请一页内存, 从页缓存中拷贝该页内容;
+     * 不经页缓存或页缓存读失败时再经缓冲区读。*/
+    if (!(page = get_free_page()))
+        oom();
+    if (cp) {
+        copy_page(cp->p_page,page);
+        release_cache_page(cp);
+    } else {
+        for (i=0 ; i<4 ; block++,i++)
+            nr[i] = bmap(current->executable,block);
+        bread_page(page,current->executable->i_dev,nr);
+    }
 
     /* 超过进程end_data部分的内容为bss段, 将bss清0。*/
     i = tmp + 4096 - current->end_data;
@@ -0,0 +1,296 @@
+/*
+ *  linux/tools/blkparse.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * blkparse reads a block-device trace drained from the trace device
+ * (char major 1, minor 5) and replays it into a per-device seek and
+ * latency report.
+ *
+ * blkparse在主机上运行, 读取从跟踪字符设备(主设备号1, 次设备号5)中取出
+ * 的块设备请求跟踪事件(见include/linux/blktrace.h), 按设备统计:
+ *   - 排队时间: 缓冲区块入队或合并(Q/M)到其所在范围被下发(D);
+ *   - 处理时间: 下发(D)到该缓冲区块结束(C);
+ *   - 总延迟:   入队或合并(Q/M)到结束(C);
+ *   - 寻道距离: 相邻两次下发之间磁头移动的扇区数。
+ * 没有下发事件的设备(如虚拟硬盘)只统计总延迟。
+ *
+ * 用法: blkparse [tracefile], 不指定文件时读标准输入。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 跟踪事件, 与include/linux/blktrace.h中的struct blk_trace_event一致
+ * (内核中long为32位, 字节序为小端), 此处按字节解析以免依赖主机的
+ * 类型长度和字节序。*/
+#define EVENT_SIZE 16
+
+#define BT_QUEUE    1
+#define BT_MERGE    2
+#define BT_DISPATCH 3
+#define BT_COMPLETE 4
+#define BT_LOST     5
+
+struct event {
+    unsigned long time;
+    unsigned long sector;
+    unsigned int dev;
+    int action;
+    int cmd;
+    unsigned int nr_sectors;
+    int pid;
+};
+
+#define NR_DEVS 16
+#define BUCKETS 32
+
+/* 一种延迟的统计: 个数, 总和, 最大值, log2(微秒)直方图 */
+struct lat {
+    unsigned long n;
+    double sum;
+    unsigned long max;
+    unsigned long hist[BUCKETS];
+};
+
+struct dev_stat {
+    unsigned int dev;
+    unsigned long events[BT_LOST+1];
+    unsigned long reads, writes;
+    struct lat wait, service, total, seek;
+    unsigned long sequential;   /* 紧接上次下发末尾的下发次数 */
+    int have_last;
+    unsigned long last_end;     /* 上次下发的结束扇区 */
+};
+
+/* 已入队尚未结束的缓冲区块 */
+struct pending {
+    unsigned int dev;
+    unsigned long sector;
+    unsigned long queued;
+    unsigned long dispatched;
+    int is_dispatched;
+    struct pending * next;
+};
+
+static struct dev_stat devs[NR_DEVS];
+static struct pending * pending = NULL;
+static unsigned long lost = 0, unmatched = 0;
+
+/* die,
+ * 往错误输出写字符串str并终止当前程序。*/
+void die(char * str)
+{
+    fprintf(stderr,"%s\n",str);
+    exit(1);
+}
+
+static unsigned long get32(const unsigned char * p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long) p[2] << 16) |
+        ((unsigned long) p[3] << 24);
+}
+
+static unsigned int get16(const unsigned char * p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/* decode,
+ * 将内核格式的16字节事件buf解析到ev中。*/
+static void decode(const unsigned char * buf, struct event * ev)
+{
+    ev->time = get32(buf);
+    ev->sector = get32(buf+4);
+    ev->dev = get16(buf+8);
+    ev->action = buf[10];
+    ev->cmd = buf[11];
+    ev->nr_sectors = get16(buf+12);
+    ev->pid = (short) get16(buf+14);
+}
+
+static struct dev_stat * get_dev(unsigned int dev)
+{
+    int i;
+
+    for (i=0 ; i<NR_DEVS ; i++) {
+        if (devs[i].dev == dev)
+            return devs+i;
+        if (!devs[i].dev) {
+            devs[i].dev = dev;
+            return devs+i;
+        }
+    }
+    die("too many devices in trace");
+    return NULL;
+}
+
+static int log2_bucket(unsigned long t)
+{
+    int i = 0;
+
+    while (t > 1 && i < BUCKETS-1) {
+        t >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/* 内核中的时刻为32位微秒值, 会回绕 */
+#define DELTA(a,b) (((a) - (b)) & 0xffffffffUL)
+
+static void add_lat(struct lat * l, unsigned long t)
+{
+    l->n++;
+    l->sum += t;
+    if (t > l->max)
+        l->max = t;
+    l->hist[log2_bucket(t)]++;
+}
+
+static void add_pending(struct event * ev)
+{
+    struct pending * p;
+
+    if (!(p = malloc(sizeof(struct pending))))
+        die("out of memory");
+    p->dev = ev->dev;
+    p->sector = ev->sector;
+    p->queued = ev->time;
+    p->is_dispatched = 0;
+    p->next = pending;
+    pending = p;
+}
+
+/* dispatch,
+ * 将[sector, sector+nr_sectors)范围内尚未下发的缓冲区块标记为已下发,
+ * 并统计寻道距离。*/
+static void dispatch(struct dev_stat * d, struct event * ev)
+{
+    struct pending * p;
+    unsigned long dist;
+
+    for (p = pending ; p ; p = p->next)
+        if (p->dev == ev->dev && !p->is_dispatched &&
+            p->sector >= ev->sector &&
+            p->sector < ev->sector + ev->nr_sectors) {
+            p->dispatched = ev->time;
+            p->is_dispatched = 1;
+        }
+    if (d->have_last) {
+        dist = ev->sector > d->last_end ? ev->sector - d->last_end :
+            d->last_end - ev->sector;
+        if (!dist)
+            d->sequential++;
+        add_lat(&d->seek,dist);
+    }
+    d->have_last = 1;
+    d->last_end = ev->sector + ev->nr_sectors;
+}
+
+static void complete(struct dev_stat * d, struct event * ev)
+{
+    struct pending ** pp, * p;
+
+    for (pp = &pending ; (p = *pp) ; pp = &p->next)
+        if (p->dev == ev->dev && p->sector == ev->sector)
+            break;
+    if (!p) {
+        unmatched++;
+        return;
+    }
+    *pp = p->next;
+    if (ev->cmd)
+        d->writes++;
+    else
+        d->reads++;
+    add_lat(&d->total,DELTA(ev->time,p->queued));
+    if (p->is_dispatched) {
+        add_lat(&d->wait,DELTA(p->dispatched,p->queued));
+        add_lat(&d->service,DELTA(ev->time,p->dispatched));
+    }
+    free(p);
+}
+
+static void print_lat(char * name, struct lat * l, char * unit)
+{
+    int i, last;
+
+    if (!l->n)
+        return;
+    printf("  %-8s n=%lu avg=%.0f%s max=%lu%s\n",name,l->n,
+        l->sum/l->n,unit,l->max,unit);
+    for (last = BUCKETS-1 ; last > 0 && !l->hist[last] ; last--)
+        /* nothing */ ;
+    for (i=0 ; i<=last ; i++)
+        if (l->hist[i])
+            printf("    [%10lu, %10lu) %8lu\n",i ? 1UL<<i : 0UL,
+                2UL<<i,l->hist[i]);
+}
+
+static void report(void)
+{
+    struct dev_stat * d;
+    int i;
+
+    for (i=0 ; i<NR_DEVS && devs[i].dev ; i++) {
+        d = devs+i;
+        printf("dev %04x: Q %lu M %lu D %lu C %lu, %lu reads, %lu writes\n",
+            d->dev,d->events[BT_QUEUE],d->events[BT_MERGE],
+            d->events[BT_DISPATCH],d->events[BT_COMPLETE],
+            d->reads,d->writes);
+        print_lat("wait",&d->wait,"us");
+        print_lat("service",&d->service,"us");
+        print_lat("total",&d->total,"us");
+        if (d->seek.n) {
+            printf("  sequential dispatches %lu of %lu\n",
+                d->sequential,d->seek.n);
+            print_lat("seek",&d->seek," sectors");
+        }
+    }
+    if (lost)
+        printf("%lu events lost (trace buffer overrun)\n",lost);
+    if (unmatched)
+        printf("%lu completions without a queue event\n",unmatched);
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned char buf[EVENT_SIZE];
+    struct event ev;
+    struct dev_stat * d;
+    FILE * f = stdin;
+
+    if (argc > 2)
+        die("Usage: blkparse [tracefile]");
+    if (argc == 2 && !(f = fopen(argv[1],"rb")))
+        die("Unable to open trace file");
+    while (fread(buf,EVENT_SIZE,1,f) == 1) {
+        decode(buf,&ev);
+        if (ev.action == BT_LOST) {
+            lost += ev.sector;
+            continue;
+        }
+        if (ev.action < BT_QUEUE || ev.action > BT_COMPLETE)
+            die("Bad event in trace file");
+        d = get_dev(ev.dev);
+        d->events[ev.action]++;
+        switch (ev.action) {
+            case BT_QUEUE:  /* 新请求入队时只含一个缓冲区块 */
+            case BT_MERGE:
+                add_pending(&ev);
+                break;
+            case BT_DISPATCH:
+                dispatch(d,&ev);
+                break;
+            case BT_COMPLETE:
+                complete(d,&ev);
+                break;
+        }
+    }
+    report();
+    return 0;
+}
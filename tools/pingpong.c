@@ -0,0 +1,75 @@
+/*
+ *  linux/tools/pingpong.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * pingpong measures the cost of a context switch: two processes bounce
+ * one byte back and forth through a pair of pipes.
+ *
+ * pingpong在本系统上运行(用本系统上的编译器和C库编译, 不属于内核
+ * 映像), 用于比较进程切换的开销。父子进程经两个管道来回传递1字节:
+ * 每一轮中父进程写管道p1后在管道p2上读等待, 子进程从p1读到数据后
+ * 写p2再在p1上读等待, 即每一轮有两次进程切换(各含一次睡眠和唤醒)。
+ * 用times返回的滴答数(10ms)计时, 轮数应足够多以使计时误差可忽略。
+ *
+ * 用法: pingpong [轮数], 默认100000轮。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/times.h>
+#include <sys/wait.h>
+
+#define DEFAULT_ROUNDS 100000
+
+/* die,
+ * 往错误输出写字符串str并终止当前程序。*/
+void die(char * str)
+{
+    fprintf(stderr,"%s\n",str);
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    int p1[2], p2[2];
+    long rounds = DEFAULT_ROUNDS, i;
+    long start, ticks, us;
+    struct tms tms;
+    char c = 0;
+    int pid;
+
+    if (argc > 2)
+        die("Usage: pingpong [rounds]");
+    if (argc == 2 && (rounds = atol(argv[1])) <= 0)
+        die("Bad number of rounds");
+    if (pipe(p1) || pipe(p2))
+        die("Unable to create pipes");
+    if ((pid = fork()) < 0)
+        die("Unable to fork");
+    if (!pid) {
+        close(p1[1]);
+        close(p2[0]);
+        while (read(p1[0],&c,1) == 1)
+            if (write(p2[1],&c,1) != 1)
+                break;
+        _exit(0);
+    }
+    close(p1[0]);
+    close(p2[1]);
+    start = times(&tms);
+    for (i = 0 ; i < rounds ; i++)
+        if (write(p1[1],&c,1) != 1 || read(p2[0],&c,1) != 1)
+            die("Pipe broken");
+    ticks = times(&tms) - start;
+    close(p1[1]);
+    wait(NULL);
+    /* 每个滴答10000微秒, 每轮两次切换 */
+    us = ticks * 10000 / rounds;
+    printf("%ld rounds, %ld switches in %ld ticks: %ld.%ld us per switch\n",
+        rounds,2*rounds,ticks,us/2,(us%2)*5);
+    return 0;
+}